@@ -0,0 +1,164 @@
+/*
+ * Times the phases of a rater run: process_groups, assign_columns,
+ * compute (aggregation and sorting) and render. Without configs on the
+ * command line it generates courses of 100 to 100000 users and measures
+ * each of them.
+ */
+#include "rater.h"
+#include "standings_gen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char *const PHASES[] = { "process_groups", "assign_columns", "compute", "render" };
+const int PHASE_COUNT = 4;
+
+/*
+ * Runs the configs 'repeat' times and prints the minimal and the median
+ * time of every phase.
+ */
+static bool bench_course(const string &label, const vector<string> &configs, int repeat, int thread_count)
+{
+    typedef chrono::steady_clock Clock;
+    vector<double> times[PHASE_COUNT];
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    OutputWriter out;
+
+    for (int run = 0; run < repeat; ++run) {
+        Course course;
+        for (const auto &path : configs) {
+            if (!course.parse_config(path.c_str())) return false;
+        }
+        if (thread_count >= 0) course.set_thread_count(thread_count);
+
+        Clock::time_point t[PHASE_COUNT + 1];
+        t[0] = Clock::now();
+        if (!course.process_groups()) return false;
+        t[1] = Clock::now();
+        course.assign_columns();
+        t[2] = Clock::now();
+        RatingResult r = course.compute();
+        t[3] = Clock::now();
+        out.reset(null_fd);
+        if (!course.render(r, out)) return false;
+        out.flush();
+        t[4] = Clock::now();
+
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            times[i].push_back(chrono::duration<double, milli>(t[i + 1] - t[i]).count());
+        }
+    }
+    out.reset(-1);
+    close(null_fd);
+
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        auto &v = times[i];
+        sort(v.begin(), v.end());
+        printf("%-12s %-16s %10.3f %10.3f\n", label.c_str(), PHASES[i], v.front(), v[v.size() / 2]);
+    }
+    fflush(stdout);
+    return true;
+}
+
+static bool parse_count(const char *val, int min_value, int &result)
+{
+    char *eptr = NULL;
+    long v = strtol(val, &eptr, 10);
+    if (!*val || *eptr || v < min_value || v > 100000000) {
+        fprintf(stderr, "invalid number '%s'\n", val);
+        return false;
+    }
+    result = v;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GenParams params;
+    vector<int> sizes;
+    vector<string> configs;
+    int repeat = 5;
+    int thread_count = -1;
+    string dir;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-') {
+            configs.push_back(opt);
+            continue;
+        }
+        if (++i >= argc) {
+            fprintf(stderr, "option '%s' requires an argument\n", opt);
+            return 1;
+        }
+        int value = 0;
+        bool ok = false;
+        if (!strcmp(opt, "-d")) {
+            dir = argv[i];
+            ok = true;
+        } else if (!strcmp(opt, "-u")) {
+            ok = parse_count(argv[i], 0, value);
+            sizes.push_back(value);
+        } else if (!strcmp(opt, "-r")) {
+            ok = parse_count(argv[i], 1, repeat);
+        } else if (!strcmp(opt, "-j")) {
+            ok = parse_count(argv[i], 0, thread_count);
+        } else if (!strcmp(opt, "-p")) {
+            ok = parse_count(argv[i], 1, params.problems);
+        } else if (!strcmp(opt, "-c")) {
+            ok = parse_count(argv[i], 1, params.categories);
+        } else if (!strcmp(opt, "-g")) {
+            ok = parse_count(argv[i], 1, params.groups);
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", opt);
+        }
+        if (!ok) return 1;
+    }
+
+    printf("%-12s %-16s %10s %10s\n", "course", "phase", "min ms", "median ms");
+    if (!configs.empty()) {
+        return bench_course("config", configs, repeat, thread_count) ? 0 : 1;
+    }
+
+    if (sizes.empty()) sizes = { 100, 1000, 10000, 100000 };
+    bool keep = !dir.empty();
+    if (!keep) {
+        char tmpl[] = "/tmp/rater-bench.XXXXXX";
+        if (!mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = tmpl;
+    }
+
+    bool ok = true;
+    for (int users : sizes) {
+        string sub = dir + "/u" + to_string(users);
+        params.users = users;
+        vector<string> paths = generate_course(sub, params);
+        if (paths.empty() || !bench_course(to_string(users), { paths.front() }, repeat, thread_count)) {
+            ok = false;
+        }
+        if (!keep) {
+            for (const auto &path : paths) unlink(path.c_str());
+            rmdir(sub.c_str());
+        }
+    }
+    if (!keep) rmdir(dir.c_str());
+    return ok ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,326 @@
+/*
+ * Checks that the incremental updates of a kept course give the same
+ * rating as a fresh run over the same files: a generated course is
+ * edited step by step (changed, removed, added and moved rows, users of
+ * several groups, users changing groups), and after every step the course updated by
+ * update_groups(), as in --watch, and the one updated by ingest_group()
+ * are rendered and compared with a course loaded from scratch.
+ *
+ *     rater-check [-u USERS] [-g GROUPS] [-p PROBLEMS] [-j N] [-d DIR]
+ */
+#include "rater.h"
+#include "standings_gen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <functional>
+#include <unistd.h>
+
+using namespace std;
+
+static bool read_file(const string &path, string &text)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) {
+        fprintf(stderr, "cannot open file '%s'\n", path.c_str());
+        return false;
+    }
+    text.clear();
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static bool write_file(const string &path, const string &text)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "cannot open file '%s'\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+// the users of a generated standings page in the row order
+static vector<string> page_users(const string &html)
+{
+    static const string mark = "<td class=\"st_team\">user";
+    vector<string> users;
+    for (size_t p = html.find(mark); p != string::npos; p = html.find(mark, p + 1)) {
+        size_t b = p + mark.size() - 4;
+        users.push_back(html.substr(b, html.find('<', b) - b));
+    }
+    return users;
+}
+
+// [begin, end) of the row of user in a generated page
+static bool find_row(const string &html, const string &user, size_t &begin, size_t &end)
+{
+    size_t p = html.find("<td class=\"st_team\">" + user + "</td>");
+    if (p == string::npos) return false;
+    begin = html.rfind("<tr>", p);
+    end = html.find("</tr>\n", p) + 6;
+    return true;
+}
+
+// changes one problem cell of the row of user
+static bool bump_row(string &html, const string &user)
+{
+    size_t b, e;
+    if (!find_row(html, user, b, e)) return false;
+    string row = html.substr(b, e - b);
+    size_t p;
+    if ((p = row.find("<td class=\"st_prob\">&nbsp;</td>")) != string::npos) {
+        row.replace(p, 31, "<td class=\"st_prob\">50</td>");
+    } else if ((p = row.find("<b>100</b>")) != string::npos) {
+        row.replace(p, 10, "99");
+    } else {
+        return false;
+    }
+    html.replace(b, e - b, row);
+    return true;
+}
+
+static bool remove_row(string &html, const string &user)
+{
+    size_t b, e;
+    if (!find_row(html, user, b, e)) return false;
+    html.erase(b, e - b);
+    return true;
+}
+
+// adds a copy of the row of user for new_user
+static bool add_row(string &html, const string &user, const string &new_user)
+{
+    size_t b, e;
+    if (!find_row(html, user, b, e)) return false;
+    string row = html.substr(b, e - b);
+    size_t p = row.find(">" + user + "<");
+    row.replace(p + 1, user.size(), new_user);
+    html.insert(e, row);
+    return true;
+}
+
+// copies the row of user from one page in front of the first row of another
+static bool copy_row(const string &from, string &to, const string &user)
+{
+    size_t b, e;
+    if (!find_row(from, user, b, e)) return false;
+    to.insert(to.find("<tr><td class=\"st_place\">"), from.substr(b, e - b));
+    return true;
+}
+
+// moves the row of user in front of the first row
+static bool move_row(string &html, const string &user)
+{
+    size_t b, e;
+    if (!find_row(html, user, b, e)) return false;
+    string row = html.substr(b, e - b);
+    html.erase(b, e - b);
+    size_t first = html.find("<tr><td class=\"st_place\">");
+    html.insert(first, row);
+    return true;
+}
+
+static string render(Course &course)
+{
+    string text;
+    OutputWriter out(1 << 16);
+    out.reset(text);
+    course.render(course.compute(), out);
+    out.flush();
+    out.reset(-1);
+    // the time of the rendering differs
+    size_t p = text.find("<p><i>Generated ");
+    if (p != string::npos) text.erase(p, text.find('\n', p) - p);
+    return text;
+}
+
+static bool same_rating(const char *label, const string &got, const string &want)
+{
+    if (got == want) return true;
+    size_t p = 0;
+    while (p < got.size() && p < want.size() && got[p] == want[p]) ++p;
+    size_t line = got.rfind('\n', p);
+    line = line == string::npos ? 0 : line + 1;
+    fprintf(stderr, "%s: differs from a fresh run at byte %zu\n  got:  %.200s\n  want: %.200s\n", label, p,
+            got.substr(line, got.find('\n', p) - line).c_str(), want.substr(line, want.find('\n', p) - line).c_str());
+    return false;
+}
+
+static bool parse_count(const char *val, int min_value, int &result)
+{
+    char *eptr = NULL;
+    long v = strtol(val, &eptr, 10);
+    if (!*val || *eptr || v < min_value || v > 100000000) {
+        fprintf(stderr, "invalid number '%s'\n", val);
+        return false;
+    }
+    result = v;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GenParams params;
+    params.users = 600;
+    params.problems = 8;
+    params.categories = 2;
+    int thread_count = -1;
+    string dir;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (++i >= argc) {
+            fprintf(stderr, "option '%s' requires an argument\n", opt);
+            return 1;
+        }
+        bool ok = false;
+        if (!strcmp(opt, "-d")) {
+            dir = argv[i];
+            ok = true;
+        } else if (!strcmp(opt, "-u")) {
+            ok = parse_count(argv[i], 20, params.users);
+        } else if (!strcmp(opt, "-g")) {
+            ok = parse_count(argv[i], 2, params.groups);
+        } else if (!strcmp(opt, "-p")) {
+            ok = parse_count(argv[i], 1, params.problems);
+        } else if (!strcmp(opt, "-j")) {
+            ok = parse_count(argv[i], 0, thread_count);
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", opt);
+        }
+        if (!ok) return 1;
+    }
+    bool keep = !dir.empty();
+    if (!keep) {
+        char tmpl[] = "/tmp/rater-check.XXXXXX";
+        if (!mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = tmpl;
+    }
+    vector<string> paths = generate_course(dir, params);
+    if (paths.empty()) return 1;
+    const int ngroups = params.groups;
+    vector<string> pages(ngroups);
+    for (int g = 0; g < ngroups; ++g) {
+        if (!read_file(paths[g + 1], pages[g])) return 1;
+    }
+
+    auto load = [&](bool keep_groups) {
+        auto course = make_unique<Course>();
+        if (!course->parse_config(paths[0].c_str())) return unique_ptr<Course>();
+        if (thread_count >= 0) course->set_thread_count(thread_count);
+        course->set_keep_groups(keep_groups);
+        if (!course->process_groups()) return unique_ptr<Course>();
+        course->assign_columns();
+        return course;
+    };
+    unique_ptr<Course> watched = load(true);
+    auto ingested = make_unique<Course>();
+    if (!watched || !ingested->parse_config(paths[0].c_str())) return 1;
+    for (int g = 0; g < ngroups; ++g) {
+        ingested->ingest_group("grp" + to_string(g), pages[g]);
+    }
+    ingested->assign_columns();
+    // the courses have computed their ratings before the first update
+    render(*watched);
+    render(*ingested);
+
+    // users of one group, and users of several groups by their first group
+    vector<vector<string> > single(ngroups), shared(ngroups);
+    {
+        vector<vector<string> > users(ngroups);
+        multiset<string> all;
+        for (int g = 0; g < ngroups; ++g) {
+            users[g] = page_users(pages[g]);
+            all.insert(users[g].begin(), users[g].end());
+        }
+        for (int g = 0; g < ngroups; ++g) {
+            for (const auto &u : users[g]) (all.count(u) > 1 ? shared : single)[g].push_back(u);
+        }
+    }
+
+    struct Step
+    {
+        const char *label;
+        function<bool(vector<string> &)> edit;
+        vector<int> groups;
+    };
+    const int last = ngroups - 1;
+    vector<Step> steps = {
+        { "changed rows", [&](vector<string> &p) {
+            return bump_row(p[1], single[1][0]) && bump_row(p[1], single[1][5]) && bump_row(p[1], single[1].back());
+        }, { 1 } },
+        { "changed row of a user of several groups", [&](vector<string> &p) {
+            return bump_row(p[0], shared[0][0]);
+        }, { 0 } },
+        { "removed row", [&](vector<string> &p) { return remove_row(p[0], single[0][3]); }, { 0 } },
+        { "added user", [&](vector<string> &p) { return add_row(p[last], single[last][2], "user999999"); }, { last } },
+        { "moved row", [&](vector<string> &p) { return move_row(p[1], single[1].back()); }, { 1 } },
+        { "removed row of a user of several groups", [&](vector<string> &p) {
+            return remove_row(p[0], shared[0][1]);
+        }, { 0 } },
+        { "user joining another group", [&](vector<string> &p) {
+            return copy_row(p[0], p[last], single[0][10]);
+        }, { last } },
+        { "changed rows of users of several groups", [&](vector<string> &p) {
+            return bump_row(p[1], shared[1][2]) && bump_row(p[1], shared[1][3]) && move_row(p[1], shared[1][4]);
+        }, { 1 } },
+        { "changed head", [&](vector<string> &p) {
+            size_t h = p[1].find("Place</th>");
+            if (h == string::npos) return false;
+            p[1].replace(h, 5, "Pl.");
+            return true;
+        }, { 1 } },
+        { "two groups", [&](vector<string> &p) {
+            return bump_row(p[0], single[0][7]) && bump_row(p[last], single[last][8]);
+        }, { 0, last } },
+    };
+
+    bool ok = true;
+    for (const auto &step : steps) {
+        if (!step.edit(pages)) {
+            fprintf(stderr, "%s: cannot edit the generated pages\n", step.label);
+            ok = false;
+            break;
+        }
+        for (int g : step.groups) {
+            if (!write_file(paths[g + 1], pages[g])) return 1;
+            ingested->ingest_group("grp" + to_string(g), pages[g]);
+        }
+        watched->update_groups(step.groups);
+        watched->assign_columns();
+        ingested->assign_columns();
+        unique_ptr<Course> fresh = load(false);
+        if (!fresh) return 1;
+        string want = render(*fresh);
+        bool good = same_rating((string(step.label) + ", update_groups").c_str(), render(*watched), want);
+        good = same_rating((string(step.label) + ", ingest_group").c_str(), render(*ingested), want) && good;
+        printf("%-45s %s\n", step.label, good ? "ok" : "FAILED");
+        ok = ok && good;
+    }
+
+    if (!keep) {
+        for (const auto &path : paths) unlink(path.c_str());
+        rmdir(dir.c_str());
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,70 @@
+#include "standings_gen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+static bool parse_count(const char *val, int min_value, int &result)
+{
+    char *eptr = NULL;
+    long v = strtol(val, &eptr, 10);
+    if (!*val || *eptr || v < min_value || v > 100000000) {
+        fprintf(stderr, "invalid number '%s'\n", val);
+        return false;
+    }
+    result = v;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GenParams params;
+    const char *dir = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-') {
+            dir = opt;
+            continue;
+        }
+        if (++i >= argc) {
+            fprintf(stderr, "option '%s' requires an argument\n", opt);
+            return 1;
+        }
+        int seed = params.seed;
+        bool ok = false;
+        if (!strcmp(opt, "-u")) {
+            ok = parse_count(argv[i], 0, params.users);
+        } else if (!strcmp(opt, "-p")) {
+            ok = parse_count(argv[i], 1, params.problems);
+        } else if (!strcmp(opt, "-c")) {
+            ok = parse_count(argv[i], 1, params.categories);
+        } else if (!strcmp(opt, "-g")) {
+            ok = parse_count(argv[i], 1, params.groups);
+        } else if (!strcmp(opt, "-s")) {
+            ok = parse_count(argv[i], 0, seed);
+            params.seed = seed;
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", opt);
+        }
+        if (!ok) return 1;
+    }
+    if (!dir) {
+        fprintf(stderr, "usage: %s [-u USERS] [-p PROBLEMS] [-c CATEGORIES] [-g GROUPS] [-s SEED] DIR\n", argv[0]);
+        return 1;
+    }
+
+    auto paths = generate_course(dir, params);
+    if (paths.empty()) return 1;
+    printf("%s\n", paths.front().c_str());
+    return 0;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
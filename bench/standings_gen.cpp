@@ -0,0 +1,198 @@
+#include "standings_gen.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*
+ * Small deterministic PRNG (splitmix64), so that a corpus can be
+ * reproduced from its parameters on any platform.
+ */
+class GenRandom
+{
+    uint64_t state;
+
+public:
+    explicit GenRandom(uint64_t seed) : state(seed) {}
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    // uniform in [0, n)
+    int below(int n) { return int(next() % uint64_t(n)); }
+};
+
+static bool write_file(const string &path, const string &text)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "cannot open file '%s': %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "write to '%s' failed\n", path.c_str());
+    return ok;
+}
+
+static string problem_name(int i)
+{
+    string name;
+    name += char('A' + i % 26);
+    if (i >= 26) name += to_string(i / 26);
+    return name;
+}
+
+struct GenRow
+{
+    int user;
+    int score;
+    int solved;
+    vector<int> cells;  // -1 for no submission, 100 is a full score
+};
+
+static void append_page(string &html, int group, const vector<GenRow> &rows, int problems)
+{
+    html += "<html><head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">";
+    html += "<title>Standings</title></head><body>\n";
+    html += "<h1>Contest " + to_string(group + 1) + "</h1>\n";
+    html += "<table border=\"1\" class=\"standings\">\n<tr><th class=\"st_place\">Place</th><th class=\"st_team\">User</th>";
+    for (int p = 0; p < problems; ++p) {
+        string pn = problem_name(p);
+        html += "<th class=\"st_prob\"><a href=\"#" + pn + "\">" + pn + "</a></th>";
+    }
+    html += "<th class=\"st_solved\">Solved</th><th class=\"st_score\">Score</th></tr>\n";
+
+    vector<int> success(problems);
+    string place;
+    for (int i = 0, last = -1; i < int(rows.size()); ++i) {
+        const GenRow &row = rows[i];
+        // equal scores share a place range, as in ejudge
+        if (i > last) {
+            last = i;
+            while (last + 1 < int(rows.size()) && rows[last + 1].score == row.score) ++last;
+            place = to_string(i + 1);
+            if (last > i) place += "-" + to_string(last + 1);
+        }
+
+        html += "<tr><td class=\"st_place\">" + place + "</td><td class=\"st_team\">user";
+        html += to_string(row.user) + "</td>";
+        for (int p = 0; p < problems; ++p) {
+            int c = row.cells[p];
+            if (c < 0) {
+                html += "<td class=\"st_prob\">&nbsp;</td>";
+            } else if (c == 100) {
+                html += "<td class=\"st_prob\"><b>100</b></td>";
+                ++success[p];
+            } else {
+                html += "<td class=\"st_prob\">" + to_string(c) + "</td>";
+            }
+        }
+        html += "<td class=\"st_solved\">" + to_string(row.solved) + "</td>";
+        html += "<td class=\"st_score\">" + to_string(row.score) + "</td></tr>\n";
+    }
+
+    // the summary rows at the bottom of an ejudge table
+    html += "<tr><td class=\"st_place\">&nbsp;</td><td class=\"st_team\">Success:</td>";
+    for (int p = 0; p < problems; ++p) html += "<td class=\"st_prob\">" + to_string(success[p]) + "</td>";
+    html += "<td>&nbsp;</td><td>&nbsp;</td></tr>\n";
+    html += "<tr><td class=\"st_place\">&nbsp;</td><td class=\"st_team\">%:</td>";
+    for (int p = 0; p < problems; ++p) {
+        int perc = rows.empty() ? 0 : success[p] * 100 / int(rows.size());
+        html += "<td class=\"st_prob\">" + to_string(perc) + "%</td>";
+    }
+    html += "<td>&nbsp;</td><td>&nbsp;</td></tr>\n";
+    html += "</table>\n</body></html>\n";
+}
+
+vector<string> generate_course(const string &dir, const GenParams &params)
+{
+    if (params.users < 0 || params.problems < 1 || params.categories < 1 || params.groups < 1) {
+        fprintf(stderr, "invalid generator parameters\n");
+        return {};
+    }
+    if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "cannot create directory '%s': %s\n", dir.c_str(), strerror(errno));
+        return {};
+    }
+    GenRandom rnd(params.seed);
+    vector<string> paths;
+
+    string cfg;
+    cfg += "sort 0\nshow_problems\nshow_percent\n";
+    for (int c = 0; c < params.categories; ++c) {
+        string cn = "cat" + to_string(c);
+        string gn = "grade" + to_string(c);
+        cfg += "category " + cn + " 1 " + gn + "\n";
+        cfg += "grade " + gn + " 0 85 5\n";
+        cfg += "grade " + gn + " 0 65 4\n";
+        cfg += "grade " + gn + " 0 40 3\n";
+        cfg += "grade " + gn + " 0 0 2\n";
+    }
+    for (int p = 0; p < params.problems; ++p) {
+        cfg += "problem " + problem_name(p) + " 100 cat" + to_string(p % params.categories) + "\n";
+    }
+    for (int g = 0; g < params.groups; ++g) {
+        cfg += "group grp" + to_string(g) + " " + dir + "/group" + to_string(g) + ".html\n";
+    }
+    paths.push_back(dir + "/course.cfg");
+    if (!write_file(paths.back(), cfg)) return {};
+
+    // the users of a group, about 5% of them are also in another group
+    vector<vector<int> > members(params.groups);
+    for (int u = 0; u < params.users; ++u) {
+        int g = u % params.groups;
+        members[g].push_back(u);
+        if (params.groups > 1 && rnd.below(20) == 0) {
+            members[(g + 1 + rnd.below(params.groups - 1)) % params.groups].push_back(u);
+        }
+    }
+
+    // per-user skill and per-problem difficulty, so that scores spread
+    vector<int> skill(params.users);
+    for (int &s : skill) s = rnd.below(100);
+    vector<int> difficulty(params.problems);
+    for (int &d : difficulty) d = rnd.below(80);
+
+    string html;
+    for (int g = 0; g < params.groups; ++g) {
+        vector<GenRow> rows;
+        rows.reserve(members[g].size());
+        for (int u : members[g]) {
+            GenRow row{u, 0, 0, vector<int>(params.problems, -1)};
+            for (int p = 0; p < params.problems; ++p) {
+                int chance = skill[u] - difficulty[p] / 2 + 30;
+                if (rnd.below(100) >= chance) continue;
+                int c = rnd.below(100) < skill[u] ? 100 : rnd.below(100);
+                row.cells[p] = c;
+                row.score += c;
+                if (c == 100) ++row.solved;
+            }
+            rows.push_back(move(row));
+        }
+        stable_sort(rows.begin(), rows.end(), [](const GenRow &a, const GenRow &b) {
+            return a.score > b.score;
+        });
+        html.clear();
+        append_page(html, g, rows, params.problems);
+        paths.push_back(dir + "/group" + to_string(g) + ".html");
+        if (!write_file(paths.back(), html)) return {};
+    }
+    return paths;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,31 @@
+/*
+ * Generator of synthetic courses: a config plus one ejudge standings
+ * page per group, shaped like the real ones. The same parameters and
+ * seed always give byte-identical files.
+ */
+#ifndef STANDINGS_GEN_H
+#define STANDINGS_GEN_H
+
+#include <string>
+#include <vector>
+
+struct GenParams
+{
+    int users = 1000;       // distinct users in the course
+    int problems = 20;
+    int categories = 4;
+    int groups = 4;
+    unsigned seed = 1;
+};
+
+// Writes DIR/course.cfg and DIR/groupN.html, creating DIR if needed; returns the written paths,
+// the config first, or an empty vector on error.
+std::vector<std::string> generate_course(const std::string &dir, const GenParams &params);
+
+#endif // STANDINGS_GEN_H
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
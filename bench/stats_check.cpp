@@ -0,0 +1,128 @@
+/*
+ * Checks the statistics of the rating against values computed directly:
+ * the percentiles of IntStats, combined from parts and with values out of
+ * the histogram, against a sorted series, and the score statistics of a
+ * course whose full score does not fit a small histogram: medians and the
+ * per-problem tenths.
+ *
+ *     rater-stats-check
+ */
+#include "rater.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+
+static bool check(bool cond, const char *what)
+{
+    if (!cond) fprintf(stderr, "FAILED: %s\n", what);
+    return cond;
+}
+
+static double exact_percentile(const vector<int> &sorted, double p)
+{
+    double pos = p * (sorted.size() - 1);
+    size_t lo = size_t(pos);
+    double v = sorted[lo];
+    if (pos > lo) v += (sorted[lo + 1] - v) * (pos - lo);
+    return v;
+}
+
+// a series with values below 0 and above the bound, added whole and in parts
+static bool check_int_stats(int bound)
+{
+    mt19937 rng(bound);
+    uniform_int_distribution<int> value(-20, bound + bound / 2 + 20);
+    vector<int> series;
+    IntStats whole(true, bound);
+    vector<IntStats> parts(3, IntStats(true, bound));
+    for (int i = 0; i < 1001; ++i) {
+        int v = value(rng);
+        series.push_back(v);
+        whole.add(v);
+        parts[i % 3].add(v);
+    }
+    IntStats merged(true, bound);
+    for (const auto &part : parts) merged.merge(part);
+    sort(series.begin(), series.end());
+
+    bool ok = true;
+    for (const IntStats *st : { &whole, &merged }) {
+        ok = check(st->get_count() == long(series.size()), "IntStats count") && ok;
+        ok = check(st->get_median() == series[series.size() / 2], "IntStats median") && ok;
+        for (double p : { 0.0, 0.1, 0.25, 0.9, 0.99, 1.0 }) {
+            ok = check(st->get_percentile(p) == exact_percentile(series, p), "IntStats percentile") && ok;
+        }
+    }
+    return ok;
+}
+
+// the scores 100000, 200000 and 300000 of the problem A with the full
+// score 300000, every user has also solved the problem B for one point
+static bool check_large_scores(const string &dir)
+{
+    string config = dir + "/course.cfg";
+    FILE *f = fopen(config.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "cannot open file '%s'\n", config.c_str());
+        return false;
+    }
+    fprintf(f, "show_problem_statistics\ncategory C 1 G\ngrade G 0 0 2\nproblem A 300000 C\nproblem B 1 C\ngroup grp %s/grp.html\n",
+            dir.c_str());
+    fclose(f);
+
+    string html = "<table class=\"standings\"><tr><th class=\"st_place\">Place</th><th class=\"st_team\">User</th>"
+                  "<th class=\"st_prob\">A</th><th class=\"st_prob\">B</th><th>Score</th></tr>\n";
+    const char *rows[] = { "100000", "200000", "<b>300000</b>" };
+    for (int i = 0; i < 3; ++i) {
+        html += "<tr><td class=\"st_place\">" + to_string(i + 1) + "</td><td class=\"st_team\">user" + to_string(i)
+              + "</td><td class=\"st_prob\">" + rows[i] + "</td><td class=\"st_prob\"><b>1</b></td><td>0</td></tr>\n";
+    }
+    html += "</table>\n";
+
+    Course course;
+    bool ok = course.parse_config(config.c_str()) && course.ingest_group("grp", html);
+    unlink(config.c_str());
+    if (!check(ok, "the course with large scores is loaded")) return false;
+    course.assign_columns();
+    RatingResult r = course.compute();
+
+    ok = check(r.groups.size() == 1 && r.groups[0].get_score_mediana() == 200001, "group score median") && ok;
+    ok = check(r.group_all.get_score_mediana() == 200001, "overall score median") && ok;
+    ok = check(r.problems.size() == 2 && r.problems[0].all.scores.get_median() == 200000, "problem score median") && ok;
+    if (r.problems.size() == 2) {
+        const int want[10] = { 0, 0, 0, 1, 0, 0, 1, 0, 0, 1 };
+        for (const ProblemStats *st : { &r.problems[0].all, &r.problems[0].groups[0] }) {
+            ok = check(equal(want, want + 10, st->tenths), "problem score tenths") && ok;
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/rater-stats-check.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    bool ok = check_int_stats(10);
+    ok = check_int_stats(100) && ok;
+    ok = check_int_stats(300000) && ok;
+    ok = check_large_scores(tmpl) && ok;
+    rmdir(tmpl);
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
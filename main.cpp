@@ -0,0 +1,711 @@
+#include "rater.h"
+#include "outputs.h"
+#include "serve.h"
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <ctime>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <cerrno>
+
+using namespace std;
+
+/*
+ * Counting allocator hook for --profile: the global operator new counts
+ * the allocations while counting is switched on. The operators are kept
+ * out of line, so that the compiler does not pair malloc() and free()
+ * with new and delete expressions.
+ */
+static atomic<bool> alloc_counting(false);
+static atomic<uint64_t> alloc_count(0);
+static atomic<uint64_t> alloc_bytes(0);
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    if (alloc_counting.load(memory_order_relaxed)) {
+        alloc_count.fetch_add(1, memory_order_relaxed);
+        alloc_bytes.fetch_add(size, memory_order_relaxed);
+    }
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static void read_alloc_counters(uint64_t &count, uint64_t &bytes)
+{
+    count = alloc_count.load(memory_order_relaxed);
+    bytes = alloc_bytes.load(memory_order_relaxed);
+}
+
+/*
+ * Watches the input files of a course with inotify. The directories are
+ * watched rather than the files, so files replaced by rename() are
+ * noticed as well. Every file is registered with a tag, wait() returns
+ * the tags of the files changed since the previous call.
+ */
+class InputWatcher
+{
+    int fd = -1;
+    map<int, set<string> > dirs;
+    map<string, set<int> > files;
+
+    static pair<string, string> split_path(const string &path)
+    {
+        size_t p = path.rfind('/');
+        if (p == string::npos) return make_pair(string("."), path);
+        if (p == 0) return make_pair(string("/"), path.substr(1));
+        return make_pair(path.substr(0, p), path.substr(p + 1));
+    }
+
+public:
+    InputWatcher()
+    {
+        fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "inotify_init1 failed: %s\n", strerror(errno));
+        }
+    }
+    InputWatcher(const InputWatcher &) = delete;
+    InputWatcher &operator = (const InputWatcher &) = delete;
+    ~InputWatcher()
+    {
+        if (fd >= 0) close(fd);
+    }
+
+    bool is_valid() const { return fd >= 0; }
+
+    bool add(const string &path, int tag)
+    {
+        auto dn = split_path(path);
+        int wd = inotify_add_watch(fd, dn.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB);
+        if (wd < 0) {
+            fprintf(stderr, "cannot watch directory '%s': %s\n", dn.first.c_str(), strerror(errno));
+            return false;
+        }
+        dirs[wd].insert(dn.first);
+        files[dn.first + "/" + dn.second].insert(tag);
+        return true;
+    }
+
+    /*
+     * Blocks until some watched file changes, then collects further
+     * events until there is none for settle_ms milliseconds.
+     */
+    set<int> wait(int settle_ms)
+    {
+        set<int> tags;
+        alignas(struct inotify_event) char buf[16384];
+        int timeout = -1;
+        while (true) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int r = poll(&pfd, 1, timeout);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                fprintf(stderr, "poll failed: %s\n", strerror(errno));
+                break;
+            }
+            if (r == 0) {
+                if (!tags.empty()) break;
+                timeout = -1;
+                continue;
+            }
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                fprintf(stderr, "read from inotify failed: %s\n", strerror(errno));
+                break;
+            }
+            for (char *p = buf; p < buf + len; ) {
+                const struct inotify_event *ev = (const struct inotify_event *) p;
+                p += sizeof(struct inotify_event) + ev->len;
+                if (!ev->len) continue;
+                auto di = dirs.find(ev->wd);
+                if (di == dirs.end()) continue;
+                for (const auto &dir : di->second) {
+                    auto fi = files.find(dir + "/" + ev->name);
+                    if (fi != files.end()) tags.insert(fi->second.begin(), fi->second.end());
+                }
+            }
+            timeout = settle_ms;
+        }
+        return tags;
+    }
+};
+
+// InputWatcher tags of the files which are not group files
+const int WATCH_CONFIG = -1;
+const int WATCH_PAGE = -2;
+
+// delay to let a series of writes to the inputs complete
+const int WATCH_SETTLE_MS = 100;
+
+static unique_ptr<Course> load_course(const vector<const char *> &configs, int thread_count, bool keep_groups,
+                                      Profile *profile = nullptr)
+{
+    auto course = make_unique<Course>();
+    course->set_profile(profile);
+    for (const char *path : configs) {
+        if (!course->parse_config(path)) return nullptr;
+    }
+    if (thread_count >= 0) course->set_thread_count(thread_count);
+    course->set_keep_groups(keep_groups);
+    if (!course->process_groups()) return nullptr;
+    course->assign_columns();
+    return course;
+}
+
+/*
+ * Processes the groups of one shard and saves them as a partial for
+ * rater-merge.
+ */
+static bool write_partial(const vector<const char *> &configs, int thread_count, int shard_index, int shard_count,
+                          const string &path, Profile *profile)
+{
+    Course course;
+    course.set_profile(profile);
+    for (const char *config : configs) {
+        if (!course.parse_config(config)) return false;
+    }
+    if (thread_count >= 0) course.set_thread_count(thread_count);
+    course.set_shard(shard_index, shard_count);
+    if (!course.process_groups()) return false;
+    OutputWriter out;
+    if (!open_output(out, path)) return false;
+    course.write_partial(out);
+    return close_output(out, path);
+}
+
+static long peak_rss_kib()
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) < 0) return 0;
+    return ru.ru_maxrss;
+}
+
+/*
+ * Prometheus metrics of the runs in the text exposition format, for the
+ * node_exporter textfile collector. The duration histograms accumulate
+ * over the runs of the process (the updates in watch mode), everything
+ * else describes the last run.
+ */
+class RunMetrics
+{
+    struct Histogram
+    {
+        vector<uint64_t> buckets;
+        uint64_t count = 0;
+        double sum = 0;
+    };
+
+    static const int BUCKET_COUNT = 12;
+    static const char *const BUCKET_NAMES[BUCKET_COUNT];
+    static const double BUCKET_BOUNDS[BUCKET_COUNT];
+
+    map<string, Histogram> phases;
+    Histogram total;
+    uint64_t runs = 0;
+    uint64_t failures = 0;
+    time_t last_run = 0;
+    Profile last;
+    uint64_t output_bytes[4] = {};
+
+    static void observe(Histogram &h, double seconds)
+    {
+        if (h.buckets.empty()) h.buckets.resize(BUCKET_COUNT);
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            if (seconds <= BUCKET_BOUNDS[i]) ++h.buckets[i];
+        }
+        ++h.count;
+        h.sum += seconds;
+    }
+
+    static void write_label(OutputWriter &out, const char *name, const string &value)
+    {
+        out << name << "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"') out << '\\' << c;
+            else if (c == '\n') out << "\\n";
+            else out << c;
+        }
+        out << '"';
+    }
+
+    static void write_header(OutputWriter &out, const string &name, const char *type, const char *help)
+    {
+        out << "# HELP " << name << ' ' << help << '\n';
+        out << "# TYPE " << name << ' ' << type << '\n';
+    }
+
+    static void write_histogram(OutputWriter &out, const string &name, const char *label, const string &value,
+                                const Histogram &h)
+    {
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            out << name << "_bucket{";
+            if (label) {
+                write_label(out, label, value);
+                out << ',';
+            }
+            out << "le=\"" << BUCKET_NAMES[i] << "\"} " << (long long) h.buckets[i] << '\n';
+        }
+        if (label) {
+            out << name << "_sum{";
+            write_label(out, label, value);
+            out << "} ";
+        } else {
+            out << name << "_sum ";
+        }
+        out.fixed(h.sum, 6) << '\n';
+        if (label) {
+            out << name << "_count{";
+            write_label(out, label, value);
+            out << "} ";
+        } else {
+            out << name << "_count ";
+        }
+        out << (long long) h.count << '\n';
+    }
+
+public:
+    // run_seconds is the wall time of the whole run, measured by the
+    // caller: the phases may overlap and do not cover all of it
+    void observe(const Profile &profile, const Outputs &outs, bool ok, double run_seconds)
+    {
+        ++runs;
+        if (!ok) ++failures;
+        last_run = time(NULL);
+        last = profile;
+        output_bytes[0] = outs.html_bytes;
+        output_bytes[1] = outs.json_bytes;
+        output_bytes[2] = outs.csv_bytes;
+        output_bytes[3] = outs.pages_bytes;
+
+        // a phase run several times ("parse_config a.cfg", "parse_config
+        // b.cfg") is one observation
+        map<string, double> seconds;
+        for (const auto &p : profile.phases) {
+            seconds[p.name.substr(0, p.name.find(' '))] += p.wall_ms / 1e3;
+        }
+        for (const auto &ps : seconds) {
+            observe(phases[ps.first], ps.second);
+        }
+        observe(total, run_seconds);
+    }
+
+    void write(OutputWriter &out) const
+    {
+        write_header(out, "rater_runs_total", "counter", "Rating runs since the start of the process.");
+        out << "rater_runs_total " << (long long) runs << '\n';
+        write_header(out, "rater_run_failures_total", "counter", "Rating runs which failed to read an input or to write an output.");
+        out << "rater_run_failures_total " << (long long) failures << '\n';
+        write_header(out, "rater_last_run_timestamp_seconds", "gauge", "Time of the last run.");
+        out << "rater_last_run_timestamp_seconds " << (long long) last_run << '\n';
+
+        write_header(out, "rater_run_duration_seconds", "histogram", "Wall time of the runs.");
+        write_histogram(out, "rater_run_duration_seconds", nullptr, string(), total);
+        write_header(out, "rater_phase_duration_seconds", "histogram", "Wall time of the phases of the runs.");
+        for (const auto &ph : phases) {
+            write_histogram(out, "rater_phase_duration_seconds", "phase", ph.first, ph.second);
+        }
+
+        write_header(out, "rater_group_file_bytes", "gauge", "Size of the group standings files.");
+        for (const auto &g : last.groups) {
+            out << "rater_group_file_bytes{";
+            write_label(out, "group", g.name);
+            out << "} " << (long long) g.bytes << '\n';
+        }
+        write_header(out, "rater_group_parse_seconds", "gauge", "Parse time of the group standings files.");
+        for (const auto &g : last.groups) {
+            out << "rater_group_parse_seconds{";
+            write_label(out, "group", g.name);
+            out << "} ";
+            out.fixed(g.parse_ms / 1e3, 6) << '\n';
+        }
+        write_header(out, "rater_group_rows", "gauge", "User rows in the group standings.");
+        for (const auto &g : last.groups) {
+            out << "rater_group_rows{";
+            write_label(out, "group", g.name);
+            out << "} " << g.rows << '\n';
+        }
+        write_header(out, "rater_group_cells", "gauge", "Result cells in the group standings.");
+        for (const auto &g : last.groups) {
+            out << "rater_group_cells{";
+            write_label(out, "group", g.name);
+            out << "} " << g.cells << '\n';
+        }
+
+        // "cells problem not found" -> rater_cells_problem_not_found
+        for (const auto &c : last.counters) {
+            string name = "rater_";
+            for (char ch : c.first) name += isalnum((unsigned char) ch) ? char(tolower(ch)) : '_';
+            write_header(out, name, "gauge", (c.first + " in the last run.").c_str());
+            out << name << ' ' << c.second << '\n';
+        }
+
+        write_header(out, "rater_output_bytes", "gauge", "Size of the outputs of the last run.");
+        static const char *const formats[] = { "html", "json", "csv", "pages" };
+        for (int i = 0; i < 4; ++i) {
+            out << "rater_output_bytes{format=\"" << formats[i] << "\"} " << (long long) output_bytes[i] << '\n';
+        }
+        write_header(out, "rater_peak_rss_bytes", "gauge", "Peak resident set size of the process.");
+        out << "rater_peak_rss_bytes " << peak_rss_kib() * 1024 << '\n';
+    }
+};
+
+const char *const RunMetrics::BUCKET_NAMES[RunMetrics::BUCKET_COUNT] =
+{
+    "0.001", "0.005", "0.01", "0.05", "0.1", "0.5", "1", "5", "10", "30", "60", "+Inf"
+};
+const double RunMetrics::BUCKET_BOUNDS[RunMetrics::BUCKET_COUNT] =
+{
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, HUGE_VAL
+};
+
+static bool write_metrics(const RunMetrics &metrics, const string &path)
+{
+    OutputWriter out(1 << 16);
+    if (!open_output(out, path)) return false;
+    metrics.write(out);
+    return close_output(out, path);
+}
+
+/*
+ * Keeps the course in memory and rewrites the output whenever its inputs
+ * change. A changed config reloads everything, a changed group file is
+ * parsed again alone, a changed header/footer/notes file is re-rendered.
+ * A group file which cannot be read keeps its previous standings, and the
+ * run counts as failed; if nothing else changed, nothing is re-rendered.
+ * With a server, every new rendering is published to it as well; the
+ * output files are then written only if -o is given.
+ */
+static int watch_course(const vector<const char *> &configs, int thread_count, Outputs &outs,
+                        const string &metrics_path, RatingServer *server)
+{
+    Profile profile;
+    Profile *prof = metrics_path.empty() ? nullptr : &profile;
+    RunMetrics metrics;
+    // a run starts with the loading or the update of the course
+    auto record_run = [&](bool ok, chrono::steady_clock::time_point start) {
+        if (prof) {
+            metrics.observe(profile, outs, ok, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            write_metrics(metrics, metrics_path);
+            profile.phases.clear();
+        }
+    };
+    auto finish_run = [&](Course &course, chrono::steady_clock::time_point start, bool ok) {
+        // the server and the files get the same rating
+        RatingResult r = course.compute();
+        if (server && !server->publish(course, r, outs)) ok = false;
+        if ((!server || !outs.html_path.empty()) && !write_output(course, r, outs)) ok = false;
+        record_run(ok, start);
+    };
+
+    auto start = chrono::steady_clock::now();
+    unique_ptr<Course> course = load_course(configs, thread_count, true, prof);
+    if (!course) return 1;
+    finish_run(*course, start, true);
+    if (server && !server->start()) return 1;
+
+    while (true) {
+        InputWatcher watcher;
+        if (!watcher.is_valid()) return 1;
+        for (const char *path : configs) {
+            watcher.add(path, WATCH_CONFIG);
+        }
+        const auto &groups = course->get_groups();
+        for (int i = 0; i < int(groups.size()); ++i) {
+            watcher.add(groups[i].get_file(), i);
+        }
+        for (const auto &path : course->get_page_files()) {
+            watcher.add(path, WATCH_PAGE);
+        }
+
+        while (true) {
+            set<int> tags = watcher.wait(WATCH_SETTLE_MS);
+            if (tags.empty()) return 1;
+            start = chrono::steady_clock::now();
+            if (tags.count(WATCH_CONFIG)) {
+                unique_ptr<Course> next = load_course(configs, thread_count, true, prof);
+                if (!next) {
+                    fprintf(stderr, "config reload failed, keeping the previous one\n");
+                    profile.phases.clear();
+                    continue;
+                }
+                course = std::move(next);
+                finish_run(*course, start, true);
+                break;
+            }
+            vector<int> changed;
+            for (int tag : tags) {
+                if (tag >= 0) changed.push_back(tag);
+            }
+            bool ok = true;
+            if (!changed.empty()) {
+                vector<int> failed;
+                if (!course->update_groups(changed, &failed)) {
+                    for (int index : failed) {
+                        fprintf(stderr, "group '%s' keeps its previous standings\n", groups[index].get_name().c_str());
+                    }
+                    // nothing to render again: the published rating stays as it is
+                    if (failed.size() == changed.size() && !tags.count(WATCH_PAGE)) {
+                        record_run(false, start);
+                        continue;
+                    }
+                    ok = false;
+                }
+                course->assign_columns();
+            }
+            finish_run(*course, start, ok);
+        }
+    }
+}
+
+/*
+ * Prints the profile of a run to the standard error or, if path is set,
+ * writes it as JSON.
+ */
+static bool write_profile(Profile &profile, const string &path)
+{
+    uint64_t count = 0, bytes = 0;
+    read_alloc_counters(count, bytes);
+    profile.set_counter("allocations", count);
+    profile.set_counter("allocated bytes", bytes);
+    profile.set_counter("peak RSS KiB", peak_rss_kib());
+    if (path.empty()) {
+        profile.write_text(stderr);
+        return true;
+    }
+    OutputWriter out(1 << 16);
+    if (!open_output(out, path)) return false;
+    profile.write_json(out);
+    return close_output(out, path);
+}
+
+int main(int argc, char *argv[])
+{
+    vector<const char *> configs;
+    int thread_count = -1;
+    bool watch = false;
+    bool profiling = false;
+    string profile_path;
+    string metrics_path;
+    string partial_path;
+    string serve_addr;
+    string serve_dir;
+    bool live = false;
+    int shard_index = 0;
+    int shard_count = 1;
+    Outputs outs;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--watch")) {
+            watch = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "-o")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '-o' requires an argument\n");
+                return 1;
+            }
+            outs.html_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--profile")) {
+            profiling = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "--profile-json")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--profile-json' requires an argument\n");
+                return 1;
+            }
+            profiling = true;
+            profile_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--metrics")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--metrics' requires an argument\n");
+                return 1;
+            }
+            metrics_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--json")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--json' requires an argument\n");
+                return 1;
+            }
+            outs.json_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--csv")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--csv' requires an argument\n");
+                return 1;
+            }
+            outs.csv_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--pages")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--pages' requires an argument\n");
+                return 1;
+            }
+            outs.pages_dir = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--gzip") || !strcmp(argv[i], "--brotli")) {
+            const char *opt = argv[i];
+            if (++i >= argc) {
+                fprintf(stderr, "option '%s' requires an argument\n", opt);
+                return 1;
+            }
+            if (!parse_compression_level(opt, argv[i], outs.compression)) return 1;
+            continue;
+        }
+        if (!strcmp(argv[i], "--live")) {
+            live = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "--serve") || !strcmp(argv[i], "--serve-dir")) {
+            const char *opt = argv[i];
+            if (++i >= argc) {
+                fprintf(stderr, "option '%s' requires an argument\n", opt);
+                return 1;
+            }
+            (strcmp(opt, "--serve") ? serve_dir : serve_addr) = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--partial")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--partial' requires an argument\n");
+                return 1;
+            }
+            partial_path = argv[i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--shard")) {
+            if (++i >= argc) {
+                fprintf(stderr, "option '--shard' requires an argument\n");
+                return 1;
+            }
+            int n = 0;
+            if (sscanf(argv[i], "%d/%d%n", &shard_index, &shard_count, &n) != 2 || argv[i][n]
+                || shard_count < 1 || shard_index < 1 || shard_index > shard_count) {
+                fprintf(stderr, "invalid shard '%s', expected K/N with 1 <= K <= N\n", argv[i]);
+                return 1;
+            }
+            --shard_index;
+            continue;
+        }
+        if (!strncmp(argv[i], "-j", 2)) {
+            const char *val = argv[i] + 2;
+            if (!*val) {
+                if (++i >= argc) {
+                    fprintf(stderr, "option '-j' requires an argument\n");
+                    return 1;
+                }
+                val = argv[i];
+            }
+            char *eptr = NULL;
+            long v = strtol(val, &eptr, 10);
+            if (*eptr || v < 0 || v > 1024) {
+                fprintf(stderr, "invalid thread count '%s'\n", val);
+                return 1;
+            }
+            thread_count = v;
+            continue;
+        }
+        configs.push_back(argv[i]);
+    }
+
+    if (shard_count > 1 && partial_path.empty()) {
+        fprintf(stderr, "option '--shard' requires '--partial'\n");
+        return 1;
+    }
+    if ((!serve_dir.empty() || live) && serve_addr.empty()) {
+        fprintf(stderr, "option '%s' requires '--serve'\n", live ? "--live" : "--serve-dir");
+        return 1;
+    }
+    if (!partial_path.empty() && (watch || !serve_addr.empty() || !metrics_path.empty())) {
+        fprintf(stderr, "option '--partial' cannot be used with '%s'\n",
+                watch ? "--watch" : !serve_addr.empty() ? "--serve" : "--metrics");
+        return 1;
+    }
+    if (watch || !serve_addr.empty()) {
+        const char *mode = watch ? "--watch" : "--serve";
+        if (outs.html_path.empty() && serve_addr.empty()) {
+            fprintf(stderr, "option '--watch' requires '-o'\n");
+            return 1;
+        }
+        if (profiling) {
+            fprintf(stderr, "option '--profile' cannot be used with '%s'\n", mode);
+            return 1;
+        }
+        unique_ptr<RatingServer> server;
+        if (!serve_addr.empty()) {
+            server = make_unique<RatingServer>(serve_dir);
+            server->set_live(live);
+            if (!server->listen(serve_addr)) return 1;
+        }
+        return watch_course(configs, thread_count, outs, metrics_path, server.get());
+    }
+
+    Profile profile;
+    if (profiling) {
+        profile.read_allocs = read_alloc_counters;
+        alloc_counting = true;
+    }
+    if (!partial_path.empty()) {
+        if (!write_partial(configs, thread_count, shard_index, shard_count, partial_path, profiling ? &profile : nullptr)) {
+            return 1;
+        }
+        if (profiling && !write_profile(profile, profile_path)) return 1;
+        return 0;
+    }
+    bool with_profile = profiling || !metrics_path.empty();
+    auto start = chrono::steady_clock::now();
+    unique_ptr<Course> course = load_course(configs, thread_count, false, with_profile ? &profile : nullptr);
+    if (!course) return 1;
+    bool ok = write_output(*course, outs);
+    if (!metrics_path.empty()) {
+        RunMetrics metrics;
+        metrics.observe(profile, outs, ok, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        if (!write_metrics(metrics, metrics_path)) ok = false;
+    }
+    if (!ok) return 1;
+    if (profiling && !write_profile(profile, profile_path)) return 1;
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,406 @@
+#include "outputs.h"
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef RATER_WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+using namespace std;
+
+/*
+ * Compressed copy of an output file, fed with the chunks the writer of
+ * the file writes out. The copy goes to its own temporary file, which
+ * replaces the copy in commit(); an uncommitted copy is removed.
+ */
+class CompressedCopy : public OutputTap
+{
+    string path;
+    string tmp_path;
+    int fd = -1;
+    bool finished = false;
+
+protected:
+    vector<uint8_t> out;
+    bool failed = false;
+
+    // writes the first n bytes of out to the temporary file
+    void drain(size_t n)
+    {
+        const uint8_t *s = out.data();
+        while (n > 0 && !failed) {
+            ssize_t w = ::write(fd, s, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                failed = true;
+                break;
+            }
+            s += w;
+            n -= w;
+        }
+    }
+
+    virtual bool start_stream() = 0;
+    virtual void finish_stream() = 0;
+
+public:
+    explicit CompressedCopy(const string &path) : path(path), tmp_path(path + ".tmp"), out(1 << 16) {}
+    ~CompressedCopy()
+    {
+        if (fd >= 0) close(fd);
+        if (fd >= 0 || finished) unlink(tmp_path.c_str());
+    }
+
+    bool start()
+    {
+        fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "cannot open file '%s'\n", tmp_path.c_str());
+            return false;
+        }
+        if (!start_stream()) {
+            fprintf(stderr, "cannot start the compression of '%s'\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool finish() override
+    {
+        if (!failed) finish_stream();
+        bool ok = !failed;
+        if (close(fd) < 0) ok = false;
+        fd = -1;
+        if (!ok) {
+            fprintf(stderr, "write to '%s' failed\n", tmp_path.c_str());
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        finished = true;
+        return true;
+    }
+
+    bool commit() override
+    {
+        finished = false;
+        if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+            fprintf(stderr, "cannot rename '%s' to '%s': %s\n", tmp_path.c_str(), path.c_str(), strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// path.gz, deflate in the gzip wrapper
+class GzipCopy : public CompressedCopy
+{
+    z_stream zs;
+    int level;
+    bool started = false;
+
+    void run(int flush)
+    {
+        int ret;
+        do {
+            zs.next_out = out.data();
+            zs.avail_out = out.size();
+            ret = deflate(&zs, flush);
+            if (ret == Z_STREAM_ERROR) {
+                failed = true;
+                return;
+            }
+            drain(out.size() - zs.avail_out);
+        } while (!failed && (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END)));
+    }
+
+protected:
+    bool start_stream() override
+    {
+        memset(&zs, 0, sizeof(zs));
+        // 15 + 16: the largest window with a gzip header and trailer
+        started = deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        return started;
+    }
+    void finish_stream() override { run(Z_FINISH); }
+
+public:
+    GzipCopy(const string &path, int level) : CompressedCopy(path + ".gz"), level(level) {}
+    ~GzipCopy()
+    {
+        if (started) deflateEnd(&zs);
+    }
+
+    void consume(const char *s, size_t n) override
+    {
+        while (n > 0 && !failed) {
+            uInt chunk = min<size_t>(n, 1u << 30);
+            zs.next_in = (Bytef *) s;
+            zs.avail_in = chunk;
+            run(Z_NO_FLUSH);
+            s += chunk;
+            n -= chunk;
+        }
+    }
+};
+
+#ifdef RATER_WITH_BROTLI
+// path.br
+class BrotliCopy : public CompressedCopy
+{
+    BrotliEncoderState *st = nullptr;
+    int level;
+
+    void run(BrotliEncoderOperation op, const uint8_t *next_in, size_t avail_in)
+    {
+        while (!failed) {
+            uint8_t *next_out = out.data();
+            size_t avail_out = out.size();
+            if (!BrotliEncoderCompressStream(st, op, &avail_in, &next_in, &avail_out, &next_out, nullptr)) {
+                failed = true;
+                return;
+            }
+            drain(out.size() - avail_out);
+            if (BrotliEncoderHasMoreOutput(st)) continue;
+            if (op == BROTLI_OPERATION_FINISH ? BrotliEncoderIsFinished(st) : avail_in == 0) return;
+        }
+    }
+
+protected:
+    bool start_stream() override
+    {
+        st = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+        if (!st) return false;
+        BrotliEncoderSetParameter(st, BROTLI_PARAM_QUALITY, level);
+        BrotliEncoderSetParameter(st, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+        return true;
+    }
+    void finish_stream() override { run(BROTLI_OPERATION_FINISH, nullptr, 0); }
+
+public:
+    BrotliCopy(const string &path, int level) : CompressedCopy(path + ".br"), level(level) {}
+    ~BrotliCopy()
+    {
+        if (st) BrotliEncoderDestroyInstance(st);
+    }
+
+    void consume(const char *s, size_t n) override
+    {
+        run(BROTLI_OPERATION_PROCESS, (const uint8_t *) s, n);
+    }
+};
+#endif
+
+static bool add_copy(OutputWriter &out, unique_ptr<CompressedCopy> copy)
+{
+    if (!copy->start()) return false;
+    out.add_tap(move(copy));
+    return true;
+}
+
+bool open_output(OutputWriter &out, const string &path, const Compression &comp)
+{
+    if (path.empty()) {
+        out.reset(STDOUT_FILENO);
+        return true;
+    }
+    string tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open file '%s'\n", tmp_path.c_str());
+        return false;
+    }
+    out.reset(fd);
+    bool ok = true;
+    if (comp.gzip_level >= 0) ok = add_copy(out, make_unique<GzipCopy>(path, comp.gzip_level));
+#ifdef RATER_WITH_BROTLI
+    if (ok && comp.brotli_level >= 0) ok = add_copy(out, make_unique<BrotliCopy>(path, comp.brotli_level));
+#endif
+    if (!ok) {
+        out.reset(-1);
+        close(fd);
+        unlink(tmp_path.c_str());
+    }
+    return ok;
+}
+
+bool parse_compression_level(const char *opt, const char *val, Compression &comp)
+{
+    bool gzip = !strcmp(opt, "--gzip");
+#ifndef RATER_WITH_BROTLI
+    if (!gzip) {
+        fprintf(stderr, "option '%s' is not supported by this build\n", opt);
+        return false;
+    }
+#endif
+    char *eptr = NULL;
+    long v = strtol(val, &eptr, 10);
+    if (!*val || *eptr || v < (gzip ? 1 : 0) || v > (gzip ? 9 : 11)) {
+        fprintf(stderr, "invalid level '%s' for option '%s', expected %s\n", val, opt, gzip ? "1-9" : "0-11");
+        return false;
+    }
+    (gzip ? comp.gzip_level : comp.brotli_level) = v;
+    return true;
+}
+
+bool close_output(OutputWriter &out, const string &path)
+{
+    if (path.empty()) {
+        if (!out.flush()) {
+            fprintf(stderr, "write to the standard output failed\n");
+            return false;
+        }
+        return true;
+    }
+    string tmp_path = path + ".tmp";
+    int fd = out.get_fd();
+    // the compressed copies replace theirs only after the file itself, so
+    // that they never hold newer contents than it
+    vector<unique_ptr<OutputTap>> copies;
+    bool ok = out.finish_taps(copies);
+    out.reset(-1);
+    if (close(fd) < 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "write to '%s' failed\n", tmp_path.c_str());
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+        fprintf(stderr, "cannot rename '%s' to '%s': %s\n", tmp_path.c_str(), path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    for (auto &c : copies) {
+        if (!c->commit()) ok = false;
+    }
+    return ok;
+}
+
+void discard_output(OutputWriter &out, const string &path)
+{
+    if (path.empty()) {
+        out.flush();
+        return;
+    }
+    int fd = out.get_fd();
+    out.reset(-1);
+    close(fd);
+    unlink((path + ".tmp").c_str());
+}
+
+/*
+ * Writes the pages of the split rating into dir. The pages are taken by
+ * the worker threads of the course one at a time; the index comes last,
+ * once all the pages it links to are in place.
+ */
+static bool write_pages(const Course &course, const RatingResult &r, const string &dir, const Compression &comp,
+                        uint64_t &bytes)
+{
+    if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "cannot create directory '%s': %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    vector<RatingPage> pages = course.get_pages(r);
+    atomic<size_t> next(0);
+    atomic<bool> ok(true);
+    atomic<uint64_t> written(0);
+    auto work = [&] {
+        OutputWriter out;
+        for (size_t i = next++; i < pages.size(); i = next++) {
+            string path = dir + "/" + pages[i].file;
+            if (!open_output(out, path, comp)) {
+                ok = false;
+                continue;
+            }
+            if (!course.render_page(r, pages[i], out)) {
+                discard_output(out, path);
+                ok = false;
+                continue;
+            }
+            written += out.get_written();
+            if (!close_output(out, path)) ok = false;
+        }
+    };
+    int count = min<size_t>(course.get_worker_count(), pages.size());
+    vector<thread> workers;
+    for (int i = 1; i < count; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &t : workers) t.join();
+
+    OutputWriter out;
+    string path = dir + "/index.html";
+    if (!open_output(out, path, comp)) return false;
+    if (!course.render_index(r, pages, out)) {
+        discard_output(out, path);
+        return false;
+    }
+    written += out.get_written();
+    bytes = written;
+    return close_output(out, path) && ok;
+}
+
+bool write_output(Course &course, Outputs &outs)
+{
+    return write_output(course, course.compute(), outs);
+}
+
+bool write_output(const Course &course, const RatingResult &r, Outputs &outs)
+{
+    const string &json_path = outs.json_path.empty() ? course.get_json_name() : outs.json_path;
+    const string &csv_path = outs.csv_path.empty() ? course.get_csv_name() : outs.csv_path;
+    bool with_json = !json_path.empty();
+    bool with_csv = !csv_path.empty();
+
+    Compression comp = outs.compression;
+    if (comp.gzip_level < 0) comp.gzip_level = course.get_gzip_level();
+    if (comp.brotli_level < 0) comp.brotli_level = course.get_brotli_level();
+#ifndef RATER_WITH_BROTLI
+    if (comp.brotli_level >= 0) {
+        static bool warned = false;
+        if (!warned) fprintf(stderr, "brotli output is not supported by this build, no .br files are written\n");
+        warned = true;
+        comp.brotli_level = -1;
+    }
+#endif
+
+    if (!open_output(outs.html, outs.html_path, comp)) return false;
+    if (with_json && !open_output(outs.json, json_path, comp)) with_json = false;
+    if (with_csv && !open_output(outs.csv, csv_path, comp)) with_csv = false;
+
+    if (!course.render(r, outs.html, with_json ? &outs.json : nullptr, with_csv ? &outs.csv : nullptr)) {
+        discard_output(outs.html, outs.html_path);
+        if (with_json) discard_output(outs.json, json_path);
+        if (with_csv) discard_output(outs.csv, csv_path);
+        return false;
+    }
+    outs.html_bytes = outs.html.get_written();
+    outs.json_bytes = with_json ? outs.json.get_written() : 0;
+    outs.csv_bytes = with_csv ? outs.csv.get_written() : 0;
+
+    bool ok = close_output(outs.html, outs.html_path);
+    if (with_json && !close_output(outs.json, json_path)) ok = false;
+    if (with_csv && !close_output(outs.csv, csv_path)) ok = false;
+    const string &pages_dir = outs.pages_dir.empty() ? course.get_pages_dir() : outs.pages_dir;
+    outs.pages_bytes = 0;
+    if (!pages_dir.empty() && !write_pages(course, r, pages_dir, comp, outs.pages_bytes)) ok = false;
+    return ok && with_json == !json_path.empty() && with_csv == !csv_path.empty();
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
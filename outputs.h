@@ -0,0 +1,67 @@
+/*
+ * Output files of the command line tools: every file is written aside
+ * and renamed into place once complete.
+ */
+#ifndef OUTPUTS_H
+#define OUTPUTS_H
+
+#include "rater.h"
+
+#include <string>
+
+/*
+ * Compressed copies written next to every output file, for static
+ * serving: path.gz at gzip_level (1-9) and path.br at brotli_level
+ * (0-11). A level of -1 leaves the copy out.
+ */
+struct Compression
+{
+    int gzip_level = -1;
+    int brotli_level = -1;
+};
+
+/*
+ * Output files of a run. Empty paths in the options fall back to the
+ * json/csv/pages directives of the config; an empty html path is the
+ * standard output.
+ */
+struct Outputs
+{
+    std::string html_path;
+    std::string json_path;
+    std::string csv_path;
+    std::string pages_dir;
+    // levels of -1 fall back to the gzip/brotli directives of the config
+    Compression compression;
+    OutputWriter html;
+    OutputWriter json;
+    OutputWriter csv;
+    // sizes of the last written outputs
+    uint64_t html_bytes = 0;
+    uint64_t json_bytes = 0;
+    uint64_t csv_bytes = 0;
+    uint64_t pages_bytes = 0;
+};
+
+// directs out to the standard output or to a temporary file next to path,
+// with the compressed copies, if any, going to their own temporary files
+bool open_output(OutputWriter &out, const std::string &path, const Compression &comp = Compression());
+// flushes out and lets the temporary files replace the output files
+bool close_output(OutputWriter &out, const std::string &path);
+// drops an incomplete output, the output files are kept as they are
+void discard_output(OutputWriter &out, const std::string &path);
+// parses the level of --gzip/--brotli, returns false if it is out of range
+bool parse_compression_level(const char *opt, const char *val, Compression &comp);
+// renders the rating and its JSON/CSV exports, if any, in one pass, then
+// the split pages, if any
+bool write_output(Course &course, Outputs &outs);
+// the same for a rating already computed by the latest course.compute()
+bool write_output(const Course &course, const RatingResult &r, Outputs &outs);
+
+#endif // OUTPUTS_H
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
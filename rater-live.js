@@ -0,0 +1,82 @@
+/*
+ * rater-live.js: keeps a rating page served by "ejudge-rater --serve
+ * --live" up to date. Put it next to sorttable.js, in the --serve-dir
+ * directory.
+ *
+ * The server renders the rating table with its version in data-live and
+ * the user of every row in data-user, then sends a "patch" event at
+ * /events for every new rendering:
+ *
+ *   {"from": V, "to": V + 1,
+ *    "rows": [{"u": USER, "n": POSITION, "place": PLACE, "html": CELLS}],
+ *    "remove": [USER...]}
+ *
+ * where the rows are those which changed or moved, "place" and "html"
+ * (the cells after the place) are only present if they changed. A
+ * "reload" event asks for the whole page.
+ */
+(function () {
+    var table = document.querySelector('table[data-live]');
+    if (!table || !window.EventSource) return;
+    var tbody = table.tBodies[0];
+
+    // the order of the rows is only kept while sorttable.js has not
+    // re-sorted the table by a column
+    function isResorted() {
+        return !!table.querySelector('th.sorttable_sorted, th.sorttable_sorted_reverse');
+    }
+
+    function applyPatch(p) {
+        if (String(p.from) !== table.getAttribute('data-live')) {
+            location.reload();
+            return;
+        }
+        var rows = {};
+        for (var i = 0; i < tbody.rows.length; ++i) {
+            rows[tbody.rows[i].getAttribute('data-user')] = tbody.rows[i];
+        }
+        p.remove.forEach(function (u) {
+            if (rows[u]) tbody.removeChild(rows[u]);
+        });
+
+        var reorder = !isResorted();
+        var moved = [];
+        p.rows.forEach(function (d) {
+            var tr = rows[d.u];
+            if (!tr) {
+                tr = document.createElement('tr');
+                tr.setAttribute('data-user', d.u);
+                tr.appendChild(document.createElement('td'));
+            }
+            if (d.html !== undefined) {
+                var place = tr.cells[0];
+                tr.innerHTML = d.html;
+                tr.insertBefore(place, tr.firstChild);
+            }
+            if (d.place !== undefined) tr.cells[0].innerHTML = d.place;
+            if (reorder) {
+                if (tr.parentNode) tbody.removeChild(tr);
+                moved.push(d);
+                d.tr = tr;
+            } else if (!tr.parentNode) {
+                tbody.appendChild(tr);
+            }
+        });
+        // the rows not listed keep their positions, so inserting the
+        // others by ascending position puts every row in its place
+        moved.sort(function (a, b) { return a.n - b.n; });
+        moved.forEach(function (d) {
+            tbody.insertBefore(d.tr, tbody.rows[d.n] || null);
+        });
+        table.setAttribute('data-live', String(p.to));
+    }
+
+    var source = new EventSource('events?since=' + encodeURIComponent(table.getAttribute('data-live')));
+    source.addEventListener('patch', function (e) {
+        applyPatch(JSON.parse(e.data));
+    });
+    source.addEventListener('reload', function () {
+        source.close();
+        location.reload();
+    });
+})();
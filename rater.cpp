@@ -1,450 +1,505 @@
+#include "rater.h"
+
+#if defined RATER_WITH_HTMLCXX
 #include <htmlcxx/html/ParserDom.h>
+#endif
 #include <string>
+#include <string_view>
+#include <cstring>
+#include <climits>
 #include <cstdio>
 #include <iostream>
+#include <charconv>
 #include <vector>
 #include <map>
 #include <algorithm>
 #include <set>
+#include <unordered_map>
 #include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
 
 using namespace std;
+#if defined RATER_WITH_HTMLCXX
 using namespace htmlcxx;
+#endif
 
-string get_current_time_str()
+static string get_current_time_str()
 {
     time_t cur = time(NULL);
-    struct tm *ptm = localtime(&cur);
+    struct tm tm;
+    localtime_r(&cur, &tm);
     char buf[64];
     snprintf(buf, sizeof(buf), "%04d/%02d/%02d %02d:%02d:%02d",
-             ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday,
-             ptm->tm_hour, ptm->tm_min, ptm->tm_sec);
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec);
     return buf;
 }
 
-enum class CellStatus
-{
-    EMPTY, PARTIAL, FULL
-};
-
-class CellId
+/*
+ * Read-only view of a whole input file. Regular files are mapped into
+ * memory, everything else (pipes, devices) is read into a private buffer.
+ * open() reports a file which cannot be read and returns false, so that a
+ * file missing for a moment does not end a long-running process.
+ */
+class MappedFile
 {
-    string user;
-    string problem;
+    const char *ptr = nullptr;
+    size_t len = 0;
+    bool mapped = false;
+    bool regular = false;
+    int64_t mtime_ns = 0;
+    string buf;
 
 public:
-    CellId(const string &user_, const string &problem_) : user(user_), problem(problem_) {}
-    const string &get_user() const { return user; }
-    const string &get_problem() const { return problem; }
-
-    int compare(const CellId &ci2) const
+    MappedFile() = default;
+    bool open(const string &path)
     {
-        int r = user.compare(ci2.user);
-        if (r != 0) return r;
-        return problem.compare(ci2.problem);
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cannot open file '%s'\n", path.c_str());
+            return false;
+        }
+        struct stat stb;
+        if (fstat(fd, &stb) >= 0 && S_ISREG(stb.st_mode)) {
+            regular = true;
+            mtime_ns = get_mtime_ns(stb);
+        }
+        if (regular && stb.st_size > 0) {
+            void *p = mmap(nullptr, stb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, stb.st_size, MADV_SEQUENTIAL);
+                ptr = (const char *) p;
+                len = stb.st_size;
+                mapped = true;
+                close(fd);
+                return true;
+            }
+        }
+        char tmp[65536];
+        ssize_t r;
+        while ((r = read(fd, tmp, sizeof(tmp))) > 0) {
+            buf.append(tmp, r);
+        }
+        close(fd);
+        if (r < 0) {
+            fprintf(stderr, "cannot read file '%s'\n", path.c_str());
+            buf.clear();
+            return false;
+        }
+        ptr = buf.data();
+        len = buf.size();
+        return true;
     }
-
-    friend bool operator == (const CellId &ci1, const CellId &ci2)
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator = (const MappedFile &) = delete;
+    ~MappedFile()
     {
-        return ci1.user == ci2.user && ci1.problem == ci2.problem;
+        if (mapped) munmap((void *) ptr, len);
     }
-    friend bool operator != (const CellId &ci1, const CellId &ci2)
+
+    string_view view() const { return string_view(ptr, len); }
+    bool is_regular() const { return regular; }
+    int64_t get_mtime_ns() const { return mtime_ns; }
+
+    static int64_t get_mtime_ns(const struct stat &stb)
     {
-        return ci1.user != ci2.user || ci1.problem != ci2.problem;
+        return int64_t(stb.st_mtim.tv_sec) * 1000000000 + stb.st_mtim.tv_nsec;
     }
-    friend bool operator < (const CellId &ci1, const CellId &ci2)
+
+    // fault the pages in, so that the I/O happens in the calling thread
+    void prefetch() const
     {
-        return ci1.compare(ci2) < 0;
+        if (!mapped) return;
+        madvise((void *) ptr, len, MADV_WILLNEED);
+        long page = sysconf(_SC_PAGESIZE);
+        volatile char sink = 0;
+        for (size_t i = 0; i < len; i += page) {
+            sink = sink + ptr[i];
+        }
+        (void) sink;
     }
-    friend bool operator <= (const CellId &ci1, const CellId &ci2)
+};
+
+static bool copy_file(OutputWriter &out, const string &path)
+{
+    MappedFile mf;
+    if (!mf.open(path)) return false;
+    out << mf.view();
+    return true;
+}
+
+/*
+ * Fixed-capacity blocking queue connecting the stages of a pipeline.
+ * pop() returns false once the queue is closed and drained.
+ */
+template<class T>
+class BoundedQueue
+{
+    deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    mutex mtx;
+    condition_variable not_empty;
+    condition_variable not_full;
+
+public:
+    explicit BoundedQueue(size_t capacity_) : capacity(capacity_ > 0?capacity_:1) {}
+
+    void push(T &&item)
     {
-        return ci1.compare(ci2) <= 0;
+        unique_lock<mutex> lock(mtx);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
     }
-    friend bool operator > (const CellId &ci1, const CellId &ci2)
+    bool pop(T &item)
     {
-        return ci1.compare(ci2) > 0;
-    }
-    friend bool operator >= (const CellId &ci1, const CellId &ci2)
+        unique_lock<mutex> lock(mtx);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+    void close()
     {
-        return ci1.compare(ci2) >= 0;
+        lock_guard<mutex> lock(mtx);
+        closed = true;
+        not_empty.notify_all();
     }
 };
 
-class Cell
+static double cpu_time_ms(clockid_t clock)
 {
-    CellStatus status = CellStatus::EMPTY;
-    int score = 0;
-
-public:
-    Cell() {}
-    Cell(CellStatus status_, int score_) : status(status_), score(score_) {}
-    CellStatus get_status() const { return status; }
-    int get_score() const { return score; }
-};
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) < 0) return 0;
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
 
-class GroupInfo
+static double ms_since(chrono::steady_clock::time_point start)
 {
-    string name;
-    string file;
-
-    int user_count = 0;
-
-    vector<int> places;
-    vector<int> scores;
-    vector<int> problems;
-
-    bool place_avg_computed = false;
-    double place_avg = 0.0;
-
-    bool score_avg_computed = false;
-    double score_avg = 0.0;
-
-    bool problem_avg_computed = false;
-    double problem_avg = 0.0;
-
-    bool place_s_computed = false;
-    double place_s = 0.0;
-
-    bool score_s_computed = false;
-    double score_s = 0.0;
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
 
-    bool problem_s_computed = false;
-    double problem_s = 0.0;
+/*
+ * Adds a phase to the profile, if any, covering the lifetime of the
+ * timer.
+ */
+class PhaseTimer
+{
+    Profile *profile;
+    Profile::Phase phase;
+    chrono::steady_clock::time_point wall;
+    double cpu = 0;
 
 public:
-    GroupInfo(const string &name_, const string &file_) : name(name_), file(file_) {}
-    const string &get_name() const { return name; }
-    const string &get_file() const { return file; }
-
-    void add_stat(int place, int score, int problem)
+    PhaseTimer(Profile *profile_, string name) : profile(profile_)
     {
-        ++user_count;
-        places.push_back(place);
-        scores.push_back(score);
-        problems.push_back(problem);
-    }
-
-    int get_user_count() const { return user_count; }
-
-    static double get_avg(const vector<int> &v)
-    {
-        if (v.size() <= 0) return 0.0;
-        double s = 0.0;
-        for (int p : v) {
-            s += p;
-        }
-        return s / v.size();
-    }
-    double get_place_avg()
+        if (!profile) return;
+        phase.name = std::move(name);
+        if (profile->read_allocs) profile->read_allocs(phase.allocs, phase.alloc_bytes);
+        cpu = cpu_time_ms(CLOCK_PROCESS_CPUTIME_ID);
+        wall = chrono::steady_clock::now();
+    }
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator = (const PhaseTimer &) = delete;
+    ~PhaseTimer()
     {
-        if (!place_avg_computed) {
-            place_avg = get_avg(places);
-            place_avg_computed = true;
+        if (!profile) return;
+        phase.wall_ms = ms_since(wall);
+        phase.cpu_ms = cpu_time_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+        if (profile->read_allocs) {
+            uint64_t allocs = 0, bytes = 0;
+            profile->read_allocs(allocs, bytes);
+            phase.allocs = allocs - phase.allocs;
+            phase.alloc_bytes = bytes - phase.alloc_bytes;
         }
-        return place_avg;
-    }
-    string get_place_avg_str()
-    {
-        if (user_count <= 0) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_place_avg());
-        return buf;
+        profile->phases.push_back(std::move(phase));
     }
-    double get_score_avg()
+};
+
+/*
+ * 64-bit hash of a byte string, eight bytes at a time.
+ */
+uint64_t hash_bytes(string_view s)
+{
+    const uint64_t m = 0xff51afd7ed558ccdULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (s.size() * m);
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+        uint64_t w;
+        memcpy(&w, s.data() + i, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29;
+    }
+    uint64_t w = 0;
+    if (i < s.size()) memcpy(&w, s.data() + i, s.size() - i);
+    h = (h ^ w) * m;
+    h ^= h >> 32;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+/*
+ * Sequential reader of the binary records (group cache, partials):
+ * fixed-size values in native byte order and length-prefixed strings.
+ * Running past the end clears ok instead of reading.
+ */
+struct BinaryReader
+{
+    string_view in;
+    size_t pos = 0;
+    bool ok = true;
+
+    template<class T>
+    T get()
     {
-        if (!score_avg_computed) {
-            score_avg = get_avg(scores);
-            score_avg_computed = true;
+        T v = T();
+        if (pos + sizeof(T) > in.size()) {
+            ok = false;
+            return v;
         }
-        return score_avg;
-    }
-    string get_score_avg_str()
-    {
-        if (user_count <= 0) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_score_avg());
-        return buf;
+        memcpy(&v, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
     }
-    double get_problem_avg()
+    string_view get_str()
     {
-        if (!problem_avg_computed) {
-            problem_avg = get_avg(problems);
-            problem_avg_computed = true;
+        uint32_t len = get<uint32_t>();
+        if (!ok || pos + len > in.size()) {
+            ok = false;
+            return string_view();
         }
-        return problem_avg;
-    }
-    string get_problem_avg_str()
-    {
-        if (user_count <= 0) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_problem_avg());
-        return buf;
+        string_view s = in.substr(pos, len);
+        pos += len;
+        return s;
     }
+};
 
-    static double get_s(const vector<int> &v, double avg)
+/*
+ * On-disk cache of parsed group files, one record per file. A record is
+ * valid while the file has the same size and either the same mtime or
+ * the same contents hash. The record layout (native byte order):
+ *   magic, version, file size, mtime in ns, contents hash, file format,
+ *   file path,
+ *   string table, user list (string indexes),
+ *   cells (user string, problem string, status, score).
+ */
+class GroupCache
+{
+    string dir;
+
+    static constexpr char MAGIC[8] = { 'R', 'A', 'T', 'E', 'R', 'G', 'R', 'P' };
+    static const uint32_t VERSION = 2;
+
+    string record_path(const string &path) const
     {
-        if (v.size() <= 1) return 0.0;
-        double s = 0.0;
-        for (int p : v) {
-            s += (p - avg) * (p - avg);
-        }
-        return sqrt(s / (v.size() - 1));
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%016llx.grp", (unsigned long long) hash_bytes(path));
+        return dir + "/" + buf;
     }
 
-    double get_place_s()
+    template<class T>
+    static void put(string &out, T v)
     {
-        if (!place_s_computed) {
-            place_s = get_s(places, get_place_avg());
-            place_s_computed = true;
-        }
-        return place_s;
+        out.append((const char *) &v, sizeof(v));
     }
-    string get_place_s_str()
+    static void put_str(string &out, string_view s)
     {
-        if (user_count <= 1) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_place_s());
-        return buf;
+        put<uint32_t>(out, s.size());
+        out.append(s.data(), s.size());
     }
-    double get_score_s()
+
+    static bool decode(BinaryReader &r, GroupData &data)
     {
-        if (!score_s_computed) {
-            score_s = get_s(scores, get_score_avg());
-            score_s_computed = true;
+        uint32_t nstr = r.get<uint32_t>();
+        if (!r.ok || nstr > r.in.size()) return false;
+        vector<string_view> strs;
+        strs.reserve(nstr);
+        for (uint32_t i = 0; i < nstr && r.ok; ++i) {
+            data.owned.emplace_back(r.get_str());
+            strs.push_back(data.owned.back());
         }
-        return score_s;
-    }
-    string get_score_s_str()
-    {
-        if (user_count <= 1) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_score_s());
-        return buf;
-    }
-    double get_problem_s()
-    {
-        if (!problem_s_computed) {
-            problem_s = get_s(problems, get_problem_avg());
-            problem_s_computed = true;
+        uint32_t nusers = r.get<uint32_t>();
+        if (!r.ok || nusers > r.in.size()) return false;
+        data.users.reserve(nusers);
+        for (uint32_t i = 0; i < nusers && r.ok; ++i) {
+            uint32_t u = r.get<uint32_t>();
+            if (u >= strs.size()) return false;
+            data.users.push_back(strs[u]);
         }
-        return problem_s;
-    }
-    string get_problem_s_str()
-    {
-        if (user_count <= 1) return "N/A";
-        char buf[64];
-        sprintf(buf, "%.2f", get_problem_s());
-        return buf;
-    }
-
-    static double get_mediana(const vector<int> &v)
-    {
-        if (v.size() <= 0) {
-            return 0.0;
-        } else if (v.size() % 2 == 0) {
-            return (v[v.size() / 2 - 1] + v[v.size() / 2] + 0.0) / 2;
-        } else {
-            return v[v.size() / 2];
+        uint32_t ncells = r.get<uint32_t>();
+        if (!r.ok || ncells > r.in.size()) return false;
+        data.cells.reserve(ncells);
+        for (uint32_t i = 0; i < ncells && r.ok; ++i) {
+            uint32_t u = r.get<uint32_t>();
+            uint32_t p = r.get<uint32_t>();
+            uint8_t status = r.get<uint8_t>();
+            int32_t score = r.get<int32_t>();
+            if (u >= strs.size() || p >= strs.size() || status > uint8_t(CellStatus::FULL)) return false;
+            data.cells.push_back(GroupData::Entry{strs[u], strs[p], Cell(CellStatus(status), score)});
         }
+        data.self_contained = true;
+        return r.ok && r.pos == r.in.size();
     }
-    double get_place_mediana() const
-    {
-        return get_mediana(places);
-    }
-    string get_place_mediana_str() const
-    {
-        char buf[64];
-        sprintf(buf, "%.2f", get_place_mediana());
-        return buf;        
-    }
-    double get_score_mediana() const
-    {
-        return get_mediana(scores);
-    }
-    string get_score_mediana_str() const
-    {
-        char buf[64];
-        sprintf(buf, "%.2f", get_score_mediana());
-        return buf;        
-    }
-    double get_problem_mediana() const
-    {
-        return get_mediana(problems);
-    }
-    string get_problem_mediana_str() const
-    {
-        char buf[64];
-        sprintf(buf, "%.2f", get_problem_mediana());
-        return buf;        
-    }
-};
-
-class ProblemInfo
-{
-    string name;
-    int score = 0;
-    string category;
-    int column = -1;
-
-public:
-    ProblemInfo(const string &name_, int score_, const string &category_) : name(name_), score(score_), category(category_) {}
-    const string &get_name() const { return name; }
-    int get_score() const { return score; }
-    const string &get_category() const { return category; }
-
-    void set_column(int column) { this->column = column; }
-    int get_column() const { return column; }
-};
-
-struct CategorySpec
-{
-    string name;
-    bool crediting;
-    string grader;
-
-    CategorySpec(const string &name_, bool crediting_, const string &grader_) : name(name_), crediting(crediting_), grader(grader_) {}
-};
-
-struct CategoryInfo
-{
-    int index = 0;
-    bool crediting = false;
-    string grader;
-    int count = 0;
-    int current = 0;
-    int start_pos = 0;
-    int max_score = 0;
-
-    CategoryInfo(int index_, bool crediting_, const string &grader_) : index(index_), crediting(crediting_), grader(grader_) {}
-};
-
-struct UserInfo
-{
-    string name;
-    string group;
-    vector<Cell> row;
-    vector<int> score_by_cat;
-    vector<int> prob_by_cat;
-    vector<int> score_by_grad;
-    vector<int> prob_by_grad;
-    vector<int> mark_by_grad;
-
-    int total_score = 0;
-    int total_prob = 0;
 
 public:
-    UserInfo(const string &name_, const string &group_, int count, int cat_count, int grad_count)
-        : name(name_), group(group_), row(count),
-          score_by_cat(cat_count), prob_by_cat(cat_count),
-          score_by_grad(grad_count), prob_by_grad(grad_count), mark_by_grad(grad_count, -1)
+    explicit GroupCache(const string &dir_) : dir(dir_)
     {
+        if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST) {
+            fprintf(stderr, "cannot create cache directory '%s': %s\n", dir.c_str(), strerror(errno));
+        }
     }
-};
-
-struct GradeInfo
-{
-    string name;
-    int mode = 0;
-    int marks[101];
-    int max_score = 0;
-    int prob_count = 0;
-
-public:
-    GradeInfo(const string &name_, int mode_) : name(name_), mode(mode_)
-    {
-        memset(marks, -1, sizeof(marks));
-    }
-};
-
-class SortByScore;
-class SortByProblems;
-
-class Course
-{
-    vector<GroupInfo> groups;
-    GroupInfo group_all{"All", ""};
-    map<string, int> groupidx;
-    vector<string> problem_order;
-    map<string, ProblemInfo> problems;
-    map<string, string> usergroups;
-    map<string, set<string> > usergrsets;
-    map<CellId, Cell> cells;
-    vector<CategorySpec> categories;
-    map<string, CategoryInfo> catinfos;
-    map<string, UserInfo> userinfos;
-    int problem_count = 0;
-    vector<GradeInfo> grades;
-    map<string, int> grade_idx;
-    int sort_mode = 0;
-    bool hide_summary = false;
-    bool show_problems = false;
-    bool show_accumulated = false;
-    bool hide_marks = false;
-    bool hide_grades = false;
-    bool show_percent = false;
-    bool hide_group = false;
-    bool hide_statistics = false;
-    string footer_name;
-    string header_name;
-    string notes_name;
-    int max_score = 0;
 
-public:
-    void add_group(const string &name, const string &file)
-    {
-        if (groupidx.find(name) != groupidx.end()) return;
-        groups.push_back(GroupInfo(name, file));
-        groupidx.insert(make_pair(name, int(groups.size() - 1)));
-    }
-    void add_problem(const string &name, int score, const string &category)
+    /*
+     * Fills data from the record of the file, if it is up to date. If the
+     * file had to be mapped to check its contents, it is left in 'file'.
+     */
+    bool load(const string &path, GroupFormat format, unique_ptr<MappedFile> &file, GroupData &data) const
     {
-        problem_order.push_back(name);
-        problems.insert(make_pair(name, ProblemInfo(name, score, category)));
-        max_score += score;
+        struct stat stb;
+        if (stat(path.c_str(), &stb) < 0 || !S_ISREG(stb.st_mode)) return false;
+        string rpath = record_path(path);
+        int fd = open(rpath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        close(fd);
+        MappedFile record;
+        if (!record.open(rpath)) return false;
+
+        BinaryReader r{record.view()};
+        string_view magic = r.in.substr(0, sizeof(MAGIC));
+        r.pos = magic.size();
+        if (magic != string_view(MAGIC, sizeof(MAGIC))) return false;
+        if (r.get<uint32_t>() != VERSION) return false;
+        uint64_t size = r.get<uint64_t>();
+        int64_t mtime_ns = r.get<int64_t>();
+        uint64_t hash = r.get<uint64_t>();
+        if (r.get<uint8_t>() != uint8_t(format)) return false;
+        if (r.get_str() != path || !r.ok) return false;
+        if (size != uint64_t(stb.st_size)) return false;
+
+        bool touched = mtime_ns != MappedFile::get_mtime_ns(stb);
+        if (touched) {
+            file = make_unique<MappedFile>();
+            if (!file->open(path)) {
+                file.reset();
+                return false;
+            }
+            if (file->view().size() != size || hash_bytes(file->view()) != hash) return false;
+        }
+        GroupData tmp;
+        if (!decode(r, tmp)) return false;
+        data = std::move(tmp);
+        if (touched) store(path, format, *file, data);
+        return true;
     }
 
-    bool parse_config(const char *path);
-    bool process_group(const GroupInfo &gi);
-    bool process_groups()
+    void store(const string &path, GroupFormat format, const MappedFile &file, const GroupData &data) const
     {
-        bool result = true;
-        for (const auto &gi : groups) {
-            result = process_group(gi) && result;
+        if (!file.is_regular()) return;
+
+        unordered_map<string_view, uint32_t> index;
+        vector<string_view> strs;
+        auto str_id = [&](string_view s) {
+            auto it = index.find(s);
+            if (it != index.end()) return it->second;
+            uint32_t id = strs.size();
+            strs.push_back(s);
+            index.emplace(s, id);
+            return id;
+        };
+        vector<uint32_t> users;
+        users.reserve(data.users.size());
+        for (const auto &u : data.users) {
+            users.push_back(str_id(u));
+        }
+        vector<pair<uint32_t, uint32_t> > cells;
+        cells.reserve(data.cells.size());
+        for (const auto &e : data.cells) {
+            cells.push_back(make_pair(str_id(e.user), str_id(e.problem)));
         }
 
-        /*
-        for (const auto &v : cells) {
-            cout << v.first.get_user() << ", " << v.first.get_problem() << " -> " << v.second.get_score() << endl;
+        string out;
+        out.append(MAGIC, sizeof(MAGIC));
+        put<uint32_t>(out, VERSION);
+        put<uint64_t>(out, file.view().size());
+        put<int64_t>(out, file.get_mtime_ns());
+        put<uint64_t>(out, hash_bytes(file.view()));
+        put<uint8_t>(out, uint8_t(format));
+        put_str(out, path);
+        put<uint32_t>(out, strs.size());
+        for (const auto &s : strs) {
+            put_str(out, s);
+        }
+        put<uint32_t>(out, users.size());
+        for (uint32_t u : users) {
+            put<uint32_t>(out, u);
+        }
+        put<uint32_t>(out, cells.size());
+        for (size_t i = 0; i < cells.size(); ++i) {
+            put<uint32_t>(out, cells[i].first);
+            put<uint32_t>(out, cells[i].second);
+            put<uint8_t>(out, uint8_t(data.cells[i].cell.get_status()));
+            put<int32_t>(out, data.cells[i].cell.get_score());
         }
-        */
 
-        return result;
+        // written aside and renamed, so that readers never see a partial record
+        string rpath = record_path(path);
+        string tmp_path = rpath + "." + to_string(getpid()) + "." + to_string(std::hash<thread::id>()(this_thread::get_id()));
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "cannot create cache file '%s': %s\n", tmp_path.c_str(), strerror(errno));
+            return;
+        }
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t w = write(fd, out.data() + done, out.size() - done);
+            if (w <= 0) break;
+            done += w;
+        }
+        close(fd);
+        if (done != out.size() || rename(tmp_path.c_str(), rpath.c_str()) < 0) {
+            fprintf(stderr, "cannot write cache file '%s'\n", rpath.c_str());
+            unlink(tmp_path.c_str());
+        }
     }
-    void assign_columns();
-    void assign_users();
-
-    friend class SortByScore;
-    friend class SortByProblems;
 };
 
-string read_file(const std::string &path)
-{
-    string buf;
-    int c;
+// prob_cat values for problems which are not counted
+const int PROB_NOT_FOUND = -1;
+const int CAT_NOT_FOUND = -2;
 
-    FILE *f = fopen(path.c_str(), "r");
-    if (!f) {
-        fprintf(stderr, "cannot open file '%s'\n", path.c_str());
-        exit(1);
-    }
-    while ((c = getc(f)) != EOF) {
-        buf.push_back(char(c));
-    }
-    return buf;
+// minimal size of a row range when a single standings table is split
+const size_t SPLIT_CHUNK_SIZE = 256 * 1024;
+// minimal number of rated users per thread for the group statistics
+const int STATS_PART_SIZE = 1 << 16;
+
+Course::Course() {}
+Course::~Course() {}
+
+void Course::invalid_line(const char *line)
+{
+    fprintf(stderr, "invalid line '%s'\n", line);
+    ++invalid_lines;
 }
 
 bool Course::parse_config(const char *path)
 {
+    PhaseTimer timer(profile, string("parse_config ") + path);
     FILE *f = fopen(path, "r");
     if (!f) {
         fprintf(stderr, "cannot open config file '%s'\n", path);
@@ -460,7 +515,7 @@ bool Course::parse_config(const char *path)
         char cmd[1024];
         int n;
         if (sscanf(buf, "%s%n", cmd, &n) != 1) {
-            fprintf(stderr, "invalid line '%s'\n", buf);
+            invalid_line(buf);
             continue;
         }
         if (!strcmp(cmd, "hide_summary")) {
@@ -479,41 +534,91 @@ bool Course::parse_config(const char *path)
             hide_group = true;
         } else if (!strcmp(cmd, "hide_statistics")) {
             hide_statistics = true;
+        } else if (!strcmp(cmd, "show_problem_statistics")) {
+            show_problem_statistics = true;
         } else if (!strcmp(cmd, "header")) {
             char ffile[1024];
             if (sscanf(buf, "%s%s%n", cmd, ffile, &n) != 2 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             header_name.assign(ffile);
         } else if (!strcmp(cmd, "notes")) {
             char ffile[1024];
             if (sscanf(buf, "%s%s%n", cmd, ffile, &n) != 2 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             notes_name.assign(ffile);
+        } else if (!strcmp(cmd, "json")) {
+            char ffile[1024];
+            if (sscanf(buf, "%s%s%n", cmd, ffile, &n) != 2 || buf[n]) {
+                invalid_line(buf);
+                continue;
+            }
+            json_name.assign(ffile);
+        } else if (!strcmp(cmd, "csv")) {
+            char ffile[1024];
+            if (sscanf(buf, "%s%s%n", cmd, ffile, &n) != 2 || buf[n]) {
+                invalid_line(buf);
+                continue;
+            }
+            csv_name.assign(ffile);
+        } else if (!strcmp(cmd, "pages")) {
+            char pdir[1024];
+            if (sscanf(buf, "%s%s%n", cmd, pdir, &n) != 2 || buf[n]) {
+                invalid_line(buf);
+                continue;
+            }
+            pages_dir.assign(pdir);
+        } else if (!strcmp(cmd, "group_pages")) {
+            group_pages = true;
+        } else if (!strcmp(cmd, "page_rows")) {
+            int rows = 0;
+            if (sscanf(buf, "%s%d%n", cmd, &rows, &n) != 2 || buf[n] || rows < 0) {
+                invalid_line(buf);
+                continue;
+            }
+            page_rows = rows;
+        } else if (!strcmp(cmd, "gzip") || !strcmp(cmd, "brotli")) {
+            int level = 0;
+            bool gzip = !strcmp(cmd, "gzip");
+            if (sscanf(buf, "%s%d%n", cmd, &level, &n) != 2 || buf[n]
+                || level < (gzip ? 1 : 0) || level > (gzip ? 9 : 11)) {
+                invalid_line(buf);
+                continue;
+            }
+            (gzip ? gzip_level : brotli_level) = level;
         } else if (!strcmp(cmd, "footer")) {
             char ffile[1024];
             if (sscanf(buf, "%s%s%n", cmd, ffile, &n) != 2 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             footer_name.assign(ffile);
         } else if (!strcmp(cmd, "group")) {
             char gname[1024];
             char gfile[1024];
-            if (sscanf(buf, "%s%s%s%n", cmd, gname, gfile, &n) != 3 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+            char gformat[1024] = "html";
+            int r = sscanf(buf, "%s%s%s%n%s%n", cmd, gname, gfile, &n, gformat, &n);
+            if (r < 3 || buf[n]) {
+                invalid_line(buf);
                 continue;
             }
-            add_group(gname, gfile);
+            GroupFormat format = GroupFormat::HTML;
+            if (!strcmp(gformat, "runlog")) {
+                format = GroupFormat::RUNLOG;
+            } else if (strcmp(gformat, "html")) {
+                invalid_line(buf);
+                continue;
+            }
+            add_group(gname, gfile, format);
         } else if (!strcmp(cmd, "problem")) {
             char pname[1024];
             int pscore = -1;
             char pcategory[1024];
             if (sscanf(buf, "%s%s%d%s%n", cmd, pname, &pscore, pcategory, &n) != 4 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             add_problem(pname, pscore, pcategory);
@@ -522,7 +627,7 @@ bool Course::parse_config(const char *path)
             int crediting;
             char cgrader[1024];
             if (sscanf(buf, "%s%s%d%s%n", cmd, cname, &crediting, cgrader, &n) != 4 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             categories.push_back(CategorySpec(cname, crediting, cgrader));
@@ -532,11 +637,11 @@ bool Course::parse_config(const char *path)
             int gperc;
             int gmark;
             if (sscanf(buf, "%s%s%d%d%d%n", cmd, gname, &gmode, &gperc, &gmark, &n) != 5 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             if (gperc < 0 || gperc > 100) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             auto gii = grade_idx.find(gname);
@@ -553,198 +658,1494 @@ bool Course::parse_config(const char *path)
         } else if (!strcmp(cmd, "sort")) {
             int sort_mode = 0;
             if (sscanf(buf, "%s%d%n", cmd, &sort_mode, &n) != 2 || buf[n]) {
-                fprintf(stderr, "invalid line '%s'\n", buf);
+                invalid_line(buf);
                 continue;
             }
             this->sort_mode = sort_mode;
+        } else if (!strcmp(cmd, "cache_dir")) {
+            char cdir[1024];
+            if (sscanf(buf, "%s%s%n", cmd, cdir, &n) != 2 || buf[n]) {
+                invalid_line(buf);
+                continue;
+            }
+            cache_dir.assign(cdir);
+        } else if (!strcmp(cmd, "threads")) {
+            int count = 0;
+            if (sscanf(buf, "%s%d%n", cmd, &count, &n) != 2 || buf[n] || count < 0) {
+                invalid_line(buf);
+                continue;
+            }
+            thread_count = count;
+        } else if (!strcmp(cmd, "parser")) {
+            char pname[1024];
+            if (sscanf(buf, "%s%s%n", cmd, pname, &n) != 2 || buf[n]) {
+                invalid_line(buf);
+                continue;
+            }
+            if (!strcmp(pname, "htmlcxx")) {
+#if defined RATER_WITH_HTMLCXX
+                use_htmlcxx = true;
+#else
+                fprintf(stderr, "htmlcxx support is not compiled in, using the builtin parser\n");
+#endif
+            } else if (!strcmp(pname, "builtin")) {
+                use_htmlcxx = false;
+            } else {
+                invalid_line(buf);
+            }
         } else {
-            fprintf(stderr, "invalid line '%s'\n", buf);
+            invalid_line(buf);
         }
     }
     fclose(f);
+    if (profile) profile->set_counter("invalid config lines", invalid_lines);
     return true;
 }
 
-bool Course::process_group(const GroupInfo &gi)
+/*
+ * Calls f(name, value) for the attributes of a tag, values unquoted but
+ * not decoded, until f returns false.
+ */
+template<class F>
+static void for_each_attr(string_view attrs, F f)
 {
-    string html = read_file(gi.get_file());
-    HTML::ParserDom parser;
-    tree<HTML::Node> dom = parser.parseTree(html);
-
-    auto root = dom.begin();
-    auto html_node = dom.end();
-    for (auto i = dom.begin(root); i != dom.end(root); ++i) {
-        if (i->isTag() && i->tagName() == "html") {
-            html_node = i;
+    size_t p = 0;
+    while (p < attrs.size()) {
+        while (p < attrs.size() && (isspace((unsigned char) attrs[p]) || attrs[p] == '/')) ++p;
+        size_t ns = p;
+        while (p < attrs.size() && attrs[p] != '=' && attrs[p] != '>' && !isspace((unsigned char) attrs[p])) ++p;
+        string_view name = attrs.substr(ns, p - ns);
+        while (p < attrs.size() && isspace((unsigned char) attrs[p])) ++p;
+        string_view val;
+        if (p < attrs.size() && attrs[p] == '=') {
+            ++p;
+            while (p < attrs.size() && isspace((unsigned char) attrs[p])) ++p;
+            if (p < attrs.size() && (attrs[p] == '"' || attrs[p] == '\'')) {
+                char q = attrs[p++];
+                size_t vs = p;
+                while (p < attrs.size() && attrs[p] != q) ++p;
+                val = attrs.substr(vs, p - vs);
+                if (p < attrs.size()) ++p;
+            } else {
+                size_t vs = p;
+                while (p < attrs.size() && !isspace((unsigned char) attrs[p])) ++p;
+                val = attrs.substr(vs, p - vs);
+            }
         }
-    }
-    /*
-    if (html_node != dom.end()) {
-        cout << *html_node << endl;
-    }
-    */
-    auto body_node = dom.end();
-    for (auto i = dom.begin(html_node); i != dom.end(html_node); ++i) {
-        if (i->isTag() && i->tagName() == "body") {
-            body_node = i;
+        if (name.empty()) {
+            if (p < attrs.size()) ++p;
+            continue;
         }
+        if (!f(name, val)) return;
     }
-    /*
-    if (body_node != dom.end()) {
-        cout << *body_node << endl;
-    }
-    */
-    auto table_node = dom.end();
-    for (auto i = dom.begin(body_node); i != dom.end(body_node); ++i) {
-        if (!i->isTag()) continue;
-        if (i->tagName() != "table") continue;
-        i->parseAttributes();
-        auto ii = i->attributes().find("class");
-        if (ii != i->attributes().end() && ii->second == "standings") {
-            table_node = i;
+}
+
+/*
+ * Single-pass scanner for ejudge standings pages. Finds the first
+ * <table class="standings"> and reports its contents as events (an
+ * ejudge page has one such table; unlike the original DOM walk, which
+ * kept the last one, the scan stops at the first so that it can stream):
+ *   header_cell(text)       - each <th>/<td> of the first row
+ *   row_begin()/row_end()   - every following <tr>
+ *   cell(text, bold)        - each <td> of a data row; bold is set when
+ *                             the text is wrapped into a tag (<b>...</b>)
+ * Texts are the raw bytes of the first child of a cell or, if that is a
+ * tag, of the first child of the tag; no entity decoding.
+ */
+class StandingsScanner
+{
+    string_view html;
+    size_t pos = 0;
+
+    struct Token
+    {
+        enum Kind { END, TEXT, OPEN, CLOSE } kind = END;
+        string_view name;   // tag name for OPEN/CLOSE
+        string_view attrs;  // attribute part for OPEN
+        string_view text;   // contents for TEXT
+    };
+
+    static bool name_eq(string_view a, const char *b)
+    {
+        size_t i = 0;
+        for (; i < a.size() && b[i]; ++i) {
+            if (tolower((unsigned char) a[i]) != b[i]) return false;
         }
+        return i == a.size() && !b[i];
     }
-    /*
-    if (table_node != dom.end()) {
-        cout << *table_node << endl;
-    }
-    */
-    auto rowi = dom.begin(table_node);
-    while (rowi != dom.end(table_node) && (!rowi->isTag() || rowi->tagName() != "tr")) ++rowi;
-    if (rowi == dom.end(table_node)) return true;
-    //cout << *rowi << endl;
-    // scan the header row
-    vector<string> col_names;
-    for (auto coli = dom.begin(rowi); coli != dom.end(rowi); ++coli) {
-        if (coli->isTag() && (coli->tagName() == "td" || coli->tagName() == "th")) {
-            auto texti = dom.begin(coli);
-            if (texti != dom.end(coli)) {
-                //cout << texti->text() << endl;
-                col_names.push_back(texti->text());
+
+    void skip_raw(const char *closing)
+    {
+        size_t len = strlen(closing);
+        while (pos < html.size()) {
+            size_t p = html.find("</", pos);
+            if (p == string_view::npos) break;
+            pos = p + 2;
+            if (name_eq(html.substr(pos, len), closing)) {
+                size_t e = html.find('>', pos);
+                pos = (e == string_view::npos)?html.size():(e + 1);
+                return;
             }
         }
+        pos = html.size();
     }
 
-    for (++rowi; rowi != dom.end(table_node); ++rowi) {
-        if (!rowi->isTag()) continue;
-        if (rowi->tagName() != "tr") continue;
-        string theuser;
-        int index = 0;
-        for (auto coli = dom.begin(rowi); coli != dom.end(rowi); ++coli) {
-            if (!coli->isTag()) continue;
-            if (coli->tagName() != "td") continue;
-            if (index >= int(col_names.size())) {
-            } else if (col_names[index] == "Place") {
-            } else if (col_names[index] == "User") {
-                auto texti = dom.begin(coli);
-                if (texti != dom.end(coli)) {
-                    theuser = texti->text();
-                }
-                if (theuser == "%:") break;
-                if (theuser == "Success:") break;
-                if (theuser == "Total:") break;
-
-                auto it = usergroups.find(theuser);
-                if (it == usergroups.end()) {
-                    usergroups.insert(make_pair(theuser, gi.get_name()));
-                } else {
-                    it->second.append(" ");
-                    it->second.append(gi.get_name());
-                }
-                auto it2 = usergrsets.find(theuser);
-                if (it2 == usergrsets.end()) {
-                    set<string> nset;
-                    nset.insert(gi.get_name());
-                    usergrsets.insert(make_pair(theuser, nset));
-                } else {
-                    it2->second.insert(gi.get_name());
-                }
-            } else if (col_names[index] == "Solved") {
-            } else if (col_names[index] == "Score") {
-            } else {
-                string text;
-                int score = -1;
-                CellStatus status = CellStatus::PARTIAL;
-                auto texti = dom.begin(coli);
-                if (texti != dom.end(coli)) {
-                    if (texti->isTag()) {
-                        auto ti2 = dom.begin(texti);
-                        if (ti2 != dom.end(texti)) {
-                            text = ti2->text();
-                            status = CellStatus::FULL;
-                        }
-                    } else {
-                        text = texti->text();
-                    }
-                }
-                if (text == "&nbsp;") text = "";
-                if (text != "") {
-                    try {
-                        score = stol(text);
-                    } catch (...) {
-                    }
-                }
-                if (theuser != "" && col_names[index] != "" && score >= 0) {
-                    cells.insert(make_pair(CellId(theuser, col_names[index]), Cell(status, score)));
+    Token next()
+    {
+        Token t;
+        while (pos < html.size()) {
+            if (html[pos] != '<') {
+                size_t e = html.find('<', pos);
+                if (e == string_view::npos) e = html.size();
+                t.kind = Token::TEXT;
+                t.text = html.substr(pos, e - pos);
+                pos = e;
+                return t;
+            }
+            if (html.compare(pos, 4, "<!--") == 0) {
+                size_t e = html.find("-->", pos + 4);
+                pos = (e == string_view::npos)?html.size():(e + 3);
+                continue;
+            }
+            size_t p = pos + 1;
+            bool closing = false;
+            if (p < html.size() && html[p] == '/') {
+                closing = true;
+                ++p;
+            }
+            size_t ns = p;
+            while (p < html.size() && isalnum((unsigned char) html[p])) ++p;
+            if (p == ns) {
+                // '<!DOCTYPE', '<?xml' and stray '<' are not interesting
+                size_t e = html.find('>', pos + 1);
+                pos = (e == string_view::npos)?html.size():(e + 1);
+                continue;
+            }
+            size_t as = p;
+            char quote = 0;
+            for (; p < html.size(); ++p) {
+                if (quote) {
+                    if (html[p] == quote) quote = 0;
+                } else if (html[p] == '"' || html[p] == '\'') {
+                    quote = html[p];
+                } else if (html[p] == '>') {
+                    break;
                 }
             }
-            ++index;
+            t.kind = closing?Token::CLOSE:Token::OPEN;
+            t.name = html.substr(ns, as - ns);
+            t.attrs = html.substr(as, p - as);
+            pos = (p < html.size())?(p + 1):p;
+            if (t.kind == Token::OPEN && (name_eq(t.name, "script") || name_eq(t.name, "style"))) {
+                skip_raw(name_eq(t.name, "script")?"script":"style");
+                continue;
+            }
+            return t;
         }
+        return t;
     }
-    return true;
-}
 
-void Course::assign_columns()
-{
-    // count categories
-    for (int i = 0; i < int(categories.size()); ++i) {
-        catinfos.insert(make_pair(categories[i].name, CategoryInfo(i, categories[i].crediting, categories[i].grader)));
+    static bool has_class(string_view attrs, string_view value)
+    {
+        bool found = false;
+        for_each_attr(attrs, [&](string_view name, string_view val) {
+            if (name_eq(name, "class") && val == value) found = true;
+            return !found;
+        });
+        return found;
     }
-    for (const auto &pi : problems) {
-        auto ci = catinfos.find(pi.second.get_category());
-        if (ci != catinfos.end()) {
-            ++ci->second.count;
-            int score = pi.second.get_score();
-            if (score > 0) {
-                ci->second.max_score += score;
-            }
+
+public:
+    explicit StandingsScanner(string_view html_) : html(html_) {}
+
+    /*
+     * Splits the rows of the standings table into at most max_chunks
+     * pieces of at least min_chunk bytes, cut right before a '<tr'.
+     * The first piece holds everything up to the first data row (the
+     * header row). Returns an empty vector when the table is not worth
+     * splitting or its body contains markup (nested tables, comments,
+     * scripts) that makes plain-text cutting unsafe.
+     */
+    static vector<string_view> split_table(string_view html, size_t max_chunks, size_t min_chunk)
+    {
+        vector<string_view> chunks;
+        if (max_chunks <= 1 || html.size() < 2 * min_chunk) return chunks;
+        string_view body;
+        size_t first;
+        if (!find_body(html, body, first)) return chunks;
+        size_t rows = body.size() - first;
+        size_t count = min(max_chunks, rows / min_chunk);
+        if (count <= 1) return chunks;
+
+        chunks.push_back(body.substr(0, first));
+        size_t cur = first;
+        for (size_t i = 1; i < count && cur < body.size(); ++i) {
+            size_t cut = body.find("<tr", max(first + rows * i / count, cur + 1));
+            if (cut == string_view::npos) break;
+            chunks.push_back(body.substr(cur, cut - cur));
+            cur = cut;
+        }
+        chunks.push_back(body.substr(cur));
+        return chunks;
+    }
+
+    /*
+     * Cuts the standings table into the part up to the first data row and
+     * the raw text of every data row, under the same conditions as
+     * split_table().
+     */
+    static bool split_rows(string_view html, string_view &head, vector<string_view> &rows)
+    {
+        string_view body;
+        size_t first;
+        if (!find_body(html, body, first)) return false;
+        head = body.substr(0, first);
+        rows.clear();
+        size_t cur = first;
+        while (cur < body.size()) {
+            size_t cut = body.find("<tr", cur + 3);
+            if (cut == string_view::npos) cut = body.size();
+            rows.push_back(body.substr(cur, cut - cur));
+            cur = cut;
+        }
+        return true;
+    }
+
+    // the inside of the standings table, and the offset of its second '<tr'
+    static bool find_body(string_view html, string_view &body, size_t &first)
+    {
+        StandingsScanner s(html);
+        if (!s.find_table()) return false;
+        size_t start = s.get_pos();
+        size_t end = html.find("</table>", start);
+        if (end == string_view::npos) return false;
+        body = html.substr(start, end - start);
+        if (body.find("<table") != string_view::npos
+            || body.find("<!--") != string_view::npos
+            || body.find("<script") != string_view::npos) {
+            return false;
+        }
+        size_t header = body.find("<tr");
+        if (header == string_view::npos) return false;
+        first = body.find("<tr", header + 3);
+        if (first == string_view::npos) first = body.size();
+        return true;
+    }
+
+    // moves past the opening tag of the standings table
+    bool find_table()
+    {
+        for (Token t = next(); t.kind != Token::END; t = next()) {
+            if (t.kind == Token::OPEN && name_eq(t.name, "table") && has_class(t.attrs, "standings")) return true;
+        }
+        return false;
+    }
+    size_t get_pos() const { return pos; }
+
+    template<class Handler>
+    void scan(Handler &handler)
+    {
+        if (find_table()) scan_table(handler, false);
+    }
+
+    /*
+     * Scans the inside of the standings table up to its closing tag.
+     * With header_seen set every <tr> is a data row, which is how the
+     * chunks of a split table are processed.
+     */
+    template<class Handler>
+    void scan_table(Handler &handler, bool header_seen)
+    {
+        int table_depth = 1;
+        bool in_header = false;
+        bool in_row = false;
+        Token t = next();
+        while (t.kind != Token::END) {
+            if (t.kind == Token::CLOSE && name_eq(t.name, "table")) {
+                if (--table_depth == 0) break;
+            } else if (t.kind == Token::OPEN && name_eq(t.name, "table")) {
+                ++table_depth;
+            } else if (t.kind == Token::OPEN && name_eq(t.name, "tr")) {
+                if (in_row) handler.row_end();
+                in_row = false;
+                in_header = !header_seen;
+                header_seen = true;
+                if (!in_header) {
+                    handler.row_begin();
+                    in_row = true;
+                }
+            } else if (t.kind == Token::OPEN && (name_eq(t.name, "td") || (in_header && name_eq(t.name, "th")))) {
+                // a cell is represented by its first child
+                string_view text;
+                bool bold = false;
+                bool present = false;
+                t = next();
+                if (t.kind == Token::TEXT) {
+                    text = t.text;
+                    present = true;
+                    t = next();
+                } else if (t.kind == Token::OPEN) {
+                    present = true;
+                    bold = true;
+                    t = next();
+                    if (t.kind == Token::TEXT) {
+                        text = t.text;
+                        t = next();
+                    } else {
+                        bold = false;
+                    }
+                }
+                if (in_header) {
+                    if (present) handler.header_cell(text);
+                } else if (in_row) {
+                    handler.cell(text, bold);
+                }
+                continue;
+            }
+            t = next();
+        }
+        if (in_row) handler.row_end();
+    }
+};
+
+#if defined RATER_WITH_HTMLCXX
+/*
+ * The same events produced from a full htmlcxx DOM; kept as a reference
+ * implementation, selected with the 'parser htmlcxx' config directive.
+ * The first standings table is taken and the cells are read as by
+ * StandingsScanner.
+ */
+template<class Handler>
+static void scan_standings_dom(const string &html, Handler &handler)
+{
+    HTML::ParserDom parser;
+    tree<HTML::Node> dom = parser.parseTree(html);
+
+    // the text of a cell and whether it is wrapped into a tag; false if
+    // the cell is empty
+    auto cell_text = [&dom](const auto &coli, string &text, bool &bold) {
+        text.clear();
+        bold = false;
+        auto texti = dom.begin(coli);
+        if (texti == dom.end(coli)) return false;
+        if (!texti->isTag()) {
+            text = texti->text();
+            return true;
+        }
+        auto ti2 = dom.begin(texti);
+        if (ti2 != dom.end(texti) && !ti2->isTag()) {
+            text = ti2->text();
+            bold = true;
+        }
+        return true;
+    };
+
+    auto table_node = dom.end();
+    for (auto i = dom.begin(); i != dom.end(); ++i) {
+        if (!i->isTag()) continue;
+        if (i->tagName() != "table") continue;
+        i->parseAttributes();
+        auto ii = i->attributes().find("class");
+        if (ii != i->attributes().end() && ii->second == "standings") {
+            table_node = i;
+            break;
+        }
+    }
+    if (table_node == dom.end()) return;
+    auto rowi = dom.begin(table_node);
+    while (rowi != dom.end(table_node) && (!rowi->isTag() || rowi->tagName() != "tr")) ++rowi;
+    if (rowi == dom.end(table_node)) return;
+    string text;
+    bool bold;
+    for (auto coli = dom.begin(rowi); coli != dom.end(rowi); ++coli) {
+        if (coli->isTag() && (coli->tagName() == "td" || coli->tagName() == "th")) {
+            if (cell_text(coli, text, bold)) handler.header_cell(text);
+        }
+    }
+    for (++rowi; rowi != dom.end(table_node); ++rowi) {
+        if (!rowi->isTag()) continue;
+        if (rowi->tagName() != "tr") continue;
+        handler.row_begin();
+        for (auto coli = dom.begin(rowi); coli != dom.end(rowi); ++coli) {
+            if (!coli->isTag()) continue;
+            if (coli->tagName() != "td") continue;
+            cell_text(coli, text, bold);
+            handler.cell(text, bold);
+        }
+        handler.row_end();
+    }
+}
+#endif
+
+/*
+ * Receives standings events and collects the users and cells of a table.
+ */
+class GroupLoader
+{
+    GroupData &data;
+    bool copy_texts;
+    vector<string_view> col_names;
+    string_view theuser;
+    int index = 0;
+    bool skip_row = false;
+
+    string_view keep(string_view text)
+    {
+        if (!copy_texts) return text;
+        data.owned.emplace_back(text);
+        return data.owned.back();
+    }
+
+public:
+    GroupLoader(GroupData &data_, bool copy_texts_ = false) : data(data_), copy_texts(copy_texts_) {}
+    GroupLoader(GroupData &data_, const vector<string_view> &col_names_) : data(data_), copy_texts(false), col_names(col_names_) {}
+
+    const vector<string_view> &get_col_names() const { return col_names; }
+
+    void header_cell(string_view text)
+    {
+        col_names.push_back(keep(text));
+    }
+    void row_begin()
+    {
+        theuser = string_view();
+        index = 0;
+        skip_row = false;
+    }
+    void row_end() {}
+    void cell(string_view text, bool bold)
+    {
+        if (skip_row) return;
+        if (index >= int(col_names.size())) {
+        } else if (col_names[index] == "Place") {
+        } else if (col_names[index] == "User") {
+            theuser = text;
+            if (theuser == "%:" || theuser == "Success:" || theuser == "Total:") {
+                skip_row = true;
+                return;
+            }
+            theuser = keep(theuser);
+            data.users.push_back(theuser);
+        } else if (col_names[index] == "Solved") {
+        } else if (col_names[index] == "Score") {
+        } else {
+            int score = -1;
+            CellStatus status = bold?CellStatus::FULL:CellStatus::PARTIAL;
+            if (text == "&nbsp;") text = string_view();
+            if (!text.empty()) {
+                score = parse_score(text);
+            }
+            if (theuser != "" && col_names[index] != "" && score >= 0) {
+                data.cells.push_back(GroupData::Entry{theuser, col_names[index], Cell(status, score)});
+            }
+        }
+        ++index;
+    }
+
+    // same as stol(): leading spaces, optional sign, at least one digit
+    static int parse_score(string_view text)
+    {
+        size_t p = 0;
+        while (p < text.size() && isspace((unsigned char) text[p])) ++p;
+        bool neg = false;
+        if (p < text.size() && (text[p] == '-' || text[p] == '+')) {
+            neg = text[p] == '-';
+            ++p;
+        }
+        if (p >= text.size() || !isdigit((unsigned char) text[p])) return -1;
+        long long v = 0;
+        for (; p < text.size() && isdigit((unsigned char) text[p]); ++p) {
+            v = v * 10 + (text[p] - '0');
+            if (v > INT_MAX) return -1;
+        }
+        return neg?int(-v):int(v);
+    }
+};
+
+/*
+ * Streaming reader of the XML run logs exported by ejudge:
+ *   <runlog ...>
+ *     <users><user id="1" name="..."/>...</users>
+ *     <problems><problem id="1" short_name="A" .../>...</problems>
+ *     <runs><run run_id="0" status="OK" user_id="1" prob_id="1" score="100" .../>...</runs>
+ *   </runlog>
+ * Every user of the log becomes a row. A cell gets the best score of the
+ * judged runs of the user on the problem and is FULL if one of them is
+ * OK. Runs without a score, hidden runs and runs that were not judged
+ * (compilation errors, ignored, disqualified, pending) are skipped, the
+ * same way the standings page shows no score for them. The texts are
+ * taken as is from the attributes, like the standings texts.
+ */
+class RunlogLoader
+{
+    struct Run
+    {
+        int user;
+        int prob;
+        int score;
+        bool full;
+    };
+
+    static int parse_id(string_view text)
+    {
+        if (text.empty()) return -1;
+        return GroupLoader::parse_score(text);
+    }
+
+    static bool is_judged(string_view status)
+    {
+        static const string_view judged[] = {
+            "OK", "PT", "AC", "PR", "WA", "RT", "TL", "PE", "ML", "WT", "SE", "SV",
+        };
+        for (string_view j : judged) {
+            if (status == j) return true;
+        }
+        return false;
+    }
+
+public:
+    static void load(string_view xml, GroupData &data)
+    {
+        vector<pair<int, string_view> > users;
+        vector<pair<int, string_view> > probs;
+        // the runs are kept until the users and the problems are all known
+        vector<Run> runs;
+
+        size_t pos = 0;
+        while ((pos = xml.find('<', pos)) != string_view::npos) {
+            ++pos;
+            if (xml.compare(pos, 3, "!--") == 0) {
+                size_t e = xml.find("-->", pos);
+                pos = (e == string_view::npos)?xml.size():(e + 3);
+                continue;
+            }
+            size_t ns = pos;
+            while (pos < xml.size() && (isalnum((unsigned char) xml[pos]) || xml[pos] == '_')) ++pos;
+            string_view name = xml.substr(ns, pos - ns);
+            size_t as = pos;
+            char quote = 0;
+            for (; pos < xml.size(); ++pos) {
+                if (quote) {
+                    if (xml[pos] == quote) quote = 0;
+                } else if (xml[pos] == '"' || xml[pos] == '\'') {
+                    quote = xml[pos];
+                } else if (xml[pos] == '>') {
+                    break;
+                }
+            }
+            string_view attrs = xml.substr(as, pos - as);
+
+            if (name == "run") {
+                Run run{-1, -1, -1, false};
+                string_view status;
+                bool hidden = false;
+                for_each_attr(attrs, [&](string_view n, string_view v) {
+                    if (n == "user_id") run.user = parse_id(v);
+                    else if (n == "prob_id") run.prob = parse_id(v);
+                    else if (n == "score") run.score = parse_id(v);
+                    else if (n == "status") status = v;
+                    else if (n == "is_hidden") hidden = v == "yes" || v == "1";
+                    return true;
+                });
+                if (run.user < 0 || run.prob < 0 || run.score < 0 || hidden || !is_judged(status)) continue;
+                run.full = status == "OK";
+                runs.push_back(run);
+            } else if (name == "user") {
+                int id = -1;
+                string_view uname, login;
+                for_each_attr(attrs, [&](string_view n, string_view v) {
+                    if (n == "id") id = parse_id(v);
+                    else if (n == "name") uname = v;
+                    else if (n == "login") login = v;
+                    return true;
+                });
+                if (uname.empty()) uname = login;
+                if (id >= 0 && !uname.empty()) users.emplace_back(id, uname);
+            } else if (name == "problem") {
+                int id = -1;
+                string_view pname;
+                for_each_attr(attrs, [&](string_view n, string_view v) {
+                    if (n == "id") id = parse_id(v);
+                    else if (n == "short_name") pname = v;
+                    return true;
+                });
+                if (id >= 0 && !pname.empty()) probs.emplace_back(id, pname);
+            }
+        }
+
+        unordered_map<int, int> user_row;
+        for (const auto &u : users) {
+            if (user_row.emplace(u.first, int(data.users.size())).second) data.users.push_back(u.second);
+        }
+        unordered_map<int, int> prob_col;
+        vector<string_view> prob_names;
+        for (const auto &p : probs) {
+            if (prob_col.emplace(p.first, int(prob_names.size())).second) prob_names.push_back(p.second);
+        }
+
+        // best score of every user on every problem, -1 if none
+        const size_t ncols = prob_names.size();
+        vector<int> best(data.users.size() * ncols, -1);
+        vector<bool> full(best.size());
+        for (const Run &run : runs) {
+            auto ui = user_row.find(run.user);
+            auto pi = prob_col.find(run.prob);
+            if (ui == user_row.end() || pi == prob_col.end()) continue;
+            size_t k = size_t(ui->second) * ncols + pi->second;
+            best[k] = max(best[k], run.score);
+            if (run.full) full[k] = true;
+        }
+        for (size_t k = 0; k < best.size(); ++k) {
+            if (best[k] < 0) continue;
+            data.cells.push_back(GroupData::Entry{data.users[k / ncols], prob_names[k % ncols],
+                                                  Cell(full[k]?CellStatus::FULL:CellStatus::PARTIAL, best[k])});
+        }
+    }
+};
+
+int Course::add_user_group(string_view user, int group)
+{
+    const string &name = groups[group].get_name();
+    int id = user_ids.intern(user);
+    if (id >= int(usergroups.size())) {
+        usergroups.resize(id + 1);
+        usergrsets.resize(id + 1);
+        usergroups[id] = name;
+    } else {
+        usergroups[id].append(" ");
+        usergroups[id].append(name);
+    }
+    vector<int> &gs = usergrsets[id];
+    auto it = lower_bound(gs.begin(), gs.end(), group);
+    if (it == gs.end() || *it != group) gs.insert(it, group);
+    return id;
+}
+
+void Course::add_cell(int user_id, string_view problem, const Cell &cell)
+{
+    int problem_id = problem_ids.intern(problem);
+    if (user_id >= cells.get_rows() || problem_id >= cells.get_cols()) {
+        cells.resize(user_ids.size(), problem_ids.size());
+    }
+    Cell &cur = cells.at(user_id, problem_id);
+    if (cur.get_status() == CellStatus::EMPTY) cur = cell;
+}
+
+void Course::load_group(string_view html, GroupData &data) const
+{
+#if defined RATER_WITH_HTMLCXX
+    if (use_htmlcxx) {
+        GroupLoader loader(data, true);
+        scan_standings_dom(string(html), loader);
+        return;
+    }
+#endif
+
+    // large tables are cut into row ranges which are parsed concurrently
+    vector<string_view> chunks = StandingsScanner::split_table(html, get_worker_count(), SPLIT_CHUNK_SIZE);
+    if (chunks.empty()) {
+        GroupLoader loader(data);
+        StandingsScanner(html).scan(loader);
+        return;
+    }
+
+    GroupLoader header_loader(data);
+    StandingsScanner(chunks[0]).scan_table(header_loader, false);
+
+    vector<GroupData> parts(chunks.size() - 1);
+    vector<thread> workers;
+    for (int i = 1; i < int(chunks.size()); ++i) {
+        workers.emplace_back([&, i] {
+            GroupLoader loader(parts[i - 1], header_loader.get_col_names());
+            StandingsScanner(chunks[i]).scan_table(loader, true);
+        });
+    }
+    for (auto &t : workers) t.join();
+
+    size_t user_count = data.users.size();
+    size_t cell_count = data.cells.size();
+    for (const auto &p : parts) {
+        user_count += p.users.size();
+        cell_count += p.cells.size();
+    }
+    data.users.reserve(user_count);
+    data.cells.reserve(cell_count);
+    for (const auto &p : parts) {
+        data.users.insert(data.users.end(), p.users.begin(), p.users.end());
+        data.cells.insert(data.cells.end(), p.cells.begin(), p.cells.end());
+    }
+}
+
+void Course::decode_group(int index, string_view text, GroupData &data) const
+{
+    if (groups[index].get_format() == GroupFormat::RUNLOG) {
+        RunlogLoader::load(text, data);
+    } else {
+        load_group(text, data);
+    }
+}
+
+void Course::merge_group(int index, const GroupData &data)
+{
+    for (const auto &user : data.users) {
+        add_user_group(user, index);
+    }
+    cells.resize(user_ids.size(), problem_ids.size());
+    // the cells of a row come together, so the user is looked up once per row
+    string_view last_user;
+    int user_id = -1;
+    for (const auto &e : data.cells) {
+        if (user_id < 0 || e.user.data() != last_user.data() || e.user.size() != last_user.size()) {
+            last_user = e.user;
+            user_id = user_ids.find(e.user);
+        }
+        add_cell(user_id, e.problem, e.cell);
+    }
+}
+
+/*
+ * Takes the group from the cache or maps its file for parse_group().
+ * Sets ready if data is complete; returns false if the file cannot be
+ * read.
+ */
+bool Course::fetch_group(int index, unique_ptr<MappedFile> &file, GroupData &data, bool &ready) const
+{
+    const string &path = groups[index].get_file();
+    Profile::Group *pg = (profile && index < int(profile->groups.size()))?&profile->groups[index]:nullptr;
+    if (cache && cache->load(path, groups[index].get_format(), file, data)) {
+        if (pg) {
+            pg->source = "cache";
+            pg->bytes = file?file->view().size():0;
+            pg->rows = data.users.size();
+            pg->cells = data.cells.size();
+        }
+        ready = true;
+        return true;
+    }
+    ready = false;
+    if (!file) {
+        file = make_unique<MappedFile>();
+        if (!file->open(path)) {
+            file.reset();
+            return false;
+        }
+    }
+    if (pg) pg->bytes = file->view().size();
+    return true;
+}
+
+void Course::parse_group(int index, const MappedFile &file, GroupData &data) const
+{
+    Profile::Group *pg = (profile && index < int(profile->groups.size()))?&profile->groups[index]:nullptr;
+    auto wall = chrono::steady_clock::now();
+    double cpu = pg?cpu_time_ms(CLOCK_THREAD_CPUTIME_ID):0;
+    decode_group(index, file.view(), data);
+    if (pg) {
+        pg->parse_ms = ms_since(wall);
+        pg->cpu_ms = cpu_time_ms(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        pg->rows = data.users.size();
+        pg->cells = data.cells.size();
+    }
+    if (cache) cache->store(groups[index].get_file(), groups[index].get_format(), file, data);
+}
+
+bool Course::process_group(int index)
+{
+    unique_ptr<MappedFile> file;
+    GroupData data;
+    bool ready;
+    if (!fetch_group(index, file, data, ready)) return false;
+    if (!ready) parse_group(index, *file, data);
+    auto wall = chrono::steady_clock::now();
+    merge_group(index, data);
+    if (profile && index < int(profile->groups.size())) profile->groups[index].merge_ms = ms_since(wall);
+    if (keep_groups) {
+        data.own();
+        loaded[index] = std::move(data);
+    }
+    return true;
+}
+
+/*
+ * Group files are processed by a pipeline: one reader thread maps the
+ * files and faults them in, thread_count parser threads scan them, and
+ * the calling thread merges the results strictly in the config order,
+ * so the outcome does not depend on the number of threads. With a shard
+ * set, only the groups of its range are processed.
+ */
+bool Course::process_groups()
+{
+    PhaseTimer timer(profile, "process_groups");
+    freeze();
+    if (profile) {
+        profile->groups.assign(groups.size(), Profile::Group());
+        for (int i = 0; i < int(groups.size()); ++i) {
+            profile->groups[i].name = groups[i].get_name();
+        }
+    }
+    if (keep_groups) {
+        loaded.resize(groups.size());
+        row_index.resize(groups.size());
+    }
+    if (!cache_dir.empty() && !cache) cache = make_unique<GroupCache>(cache_dir);
+    int first, last;
+    get_shard_range(first, last);
+    int count = get_worker_count();
+    if (count <= 1 || last - first <= 1) {
+        bool result = true;
+        for (int i = first; i < last; ++i) {
+            result = process_group(i) && result;
+        }
+        return result;
+    }
+
+    struct Job
+    {
+        int index = -1;
+        bool failed = false;
+        bool ready = false;
+        unique_ptr<MappedFile> file;
+        GroupData data;
+    };
+
+    BoundedQueue<Job> to_parse(count * 2);
+    BoundedQueue<Job> to_merge(count * 2);
+
+    thread reader([&] {
+        for (int i = first; i < last; ++i) {
+            Job job;
+            job.index = i;
+            job.failed = !fetch_group(i, job.file, job.data, job.ready);
+            if (!job.failed && !job.ready) job.file->prefetch();
+            to_parse.push(std::move(job));
+        }
+        to_parse.close();
+    });
+
+    vector<thread> parsers;
+    for (int i = 0; i < count; ++i) {
+        parsers.emplace_back([&] {
+            Job job;
+            while (to_parse.pop(job)) {
+                if (!job.failed && !job.ready) parse_group(job.index, *job.file, job.data);
+                to_merge.push(std::move(job));
+            }
+        });
+    }
+
+    thread closer([&] {
+        reader.join();
+        for (auto &t : parsers) t.join();
+        to_merge.close();
+    });
+
+    // a group which cannot be read is left out, as by process_group()
+    map<int, Job> pending;
+    int next = first;
+    bool result = true;
+    Job job;
+    while (to_merge.pop(job)) {
+        int index = job.index;
+        pending.emplace(index, std::move(job));
+        for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+            if (it->second.failed) {
+                result = false;
+                pending.erase(it);
+                ++next;
+                continue;
+            }
+            auto wall = chrono::steady_clock::now();
+            merge_group(next, it->second.data);
+            if (profile) profile->groups[next].merge_ms = ms_since(wall);
+            if (keep_groups) {
+                it->second.data.own();
+                loaded[next] = std::move(it->second.data);
+            }
+            pending.erase(it);
+            ++next;
+        }
+    }
+    closer.join();
+    return result;
+}
+
+/*
+ * Decodes the changed group file row by row, reusing the decoded rows
+ * of the previous version whose raw text did not change. If the header
+ * row is the same as before, partial is set and the rows that appeared
+ * and disappeared are returned in added and removed. Returns false if
+ * the table cannot be cut into rows.
+ */
+bool Course::reparse_rows(int index, string_view html, GroupData &data, bool &partial,
+                          vector<shared_ptr<const GroupData> > &added, vector<shared_ptr<const GroupData> > &removed)
+{
+    string_view head;
+    vector<string_view> texts;
+    if (use_htmlcxx || !StandingsScanner::split_rows(html, head, texts)) return false;
+
+    GroupRows &prev = row_index[index];
+    GroupRows cur;
+    cur.valid = true;
+    cur.head_hash = hash_bytes(head);
+    bool same_head = prev.valid && prev.head_hash == cur.head_hash;
+    partial = same_head;
+
+    GroupData header_data;
+    GroupLoader header_loader(header_data);
+    StandingsScanner(head).scan_table(header_loader, false);
+
+    // previous rows by fingerprint; equal rows are matched in order, the
+    // texts are compared so that a hash collision is not taken for a match
+    unordered_multimap<uint64_t, int> old_rows;
+    if (same_head) {
+        for (int i = int(prev.hashes.size()) - 1; i >= 0; --i) {
+            old_rows.emplace(prev.hashes[i], i);
+        }
+    }
+    vector<bool> reused(prev.rows.size());
+    for (const auto &text : texts) {
+        uint64_t h = hash_bytes(text);
+        shared_ptr<const GroupData> row;
+        for (auto range = old_rows.equal_range(h); range.first != range.second; ++range.first) {
+            int i = range.first->second;
+            if (!reused[i] && prev.texts[i] == text) {
+                reused[i] = true;
+                row = prev.rows[i];
+                old_rows.erase(range.first);
+                break;
+            }
+        }
+        if (!row) {
+            auto fresh = make_shared<GroupData>();
+            GroupLoader loader(*fresh, header_loader.get_col_names());
+            StandingsScanner(text).scan_table(loader, true);
+            fresh->own();
+            row = fresh;
+            if (same_head) added.push_back(row);
+        }
+        cur.hashes.push_back(h);
+        cur.texts.emplace_back(text);
+        cur.rows.push_back(row);
+    }
+    if (same_head) {
+        for (int i = 0; i < int(prev.rows.size()); ++i) {
+            if (!reused[i]) removed.push_back(prev.rows[i]);
+        }
+    }
+
+    for (const auto &row : cur.rows) {
+        data.users.insert(data.users.end(), row->users.begin(), row->users.end());
+        data.cells.insert(data.cells.end(), row->cells.begin(), row->cells.end());
+    }
+    data.parts = cur.rows;
+    data.self_contained = true;
+    prev = std::move(cur);
+    return true;
+}
+
+/*
+ * Brings the merged tables up to date for the users of the changed rows
+ * alone, or of the whole group if it was decoded anew: their memberships
+ * and cells are merged again from the kept groups they are in, in the
+ * group order, as merge_group() does. Only those groups are scanned.
+ * Returns false if a user came or left, as the users are then numbered
+ * anew by a rebuild.
+ */
+bool Course::remerge_users(const vector<GroupUpdate> &updates)
+{
+    vector<bool> scan(groups.size());
+    unordered_map<string_view, int> touched;  // user -> id
+    auto touch = [&](const vector<string_view> &users) {
+        for (const auto &user : users) {
+            int id = user_ids.find(user);
+            if (id < 0) return false;
+            touched.emplace(user_ids.get_name(id), id);
+        }
+        return true;
+    };
+    for (const auto &u : updates) {
+        scan[u.index] = true;
+        if (!u.partial) {
+            if (!touch(u.previous->users) || !touch(loaded[u.index].users)) return false;
+            continue;
+        }
+        for (const auto *rows : { &u.added, &u.removed }) {
+            for (const auto &row : *rows) {
+                if (!touch(row->users)) return false;
+            }
+        }
+    }
+    for (const auto &t : touched) {
+        for (int g : usergrsets[t.second]) scan[g] = true;
+        usergroups[t.second].clear();
+        usergrsets[t.second].clear();
+        for (int p = 0; p < cells.get_cols(); ++p) {
+            cells.at(t.second, p) = Cell();
+        }
+    }
+
+    for (int g = 0; g < int(groups.size()); ++g) {
+        if (!scan[g]) continue;
+        const GroupData &data = loaded[g];
+        for (const auto &user : data.users) {
+            auto it = touched.find(user);
+            if (it == touched.end()) continue;
+            string &names = usergroups[it->second];
+            if (!names.empty()) names.append(" ");
+            names.append(groups[g].get_name());
+            vector<int> &gs = usergrsets[it->second];
+            if (gs.empty() || gs.back() != g) gs.push_back(g);
+        }
+        string_view last_user;
+        int user_id = -1;
+        for (size_t i = 0; i < data.cells.size(); ++i) {
+            const auto &e = data.cells[i];
+            if (i == 0 || e.user.data() != last_user.data() || e.user.size() != last_user.size()) {
+                last_user = e.user;
+                auto it = touched.find(e.user);
+                user_id = it == touched.end() ? -1 : it->second;
+            }
+            if (user_id >= 0) add_cell(user_id, e.problem, e.cell);
+        }
+    }
+    for (const auto &t : touched) {
+        if (usergrsets[t.second].empty()) return false;
+    }
+    return true;
+}
+
+/*
+ * Decodes a new version of a kept group into data. Only the changed rows
+ * are decoded when possible, see reparse_rows().
+ */
+void Course::decode_update(GroupUpdate &update, string_view html, GroupData &data)
+{
+    if (groups[update.index].get_format() != GroupFormat::HTML
+        || !reparse_rows(update.index, html, data, update.partial, update.added, update.removed)) {
+        row_index[update.index] = GroupRows();
+        decode_group(update.index, html, data);
+        update.partial = false;
+    }
+}
+
+/*
+ * Brings the merged tables up to date after kept groups were replaced.
+ * While the same users remain, only the users of the changes are merged
+ * again; otherwise the tables are rebuilt from the kept contents of all
+ * groups.
+ */
+void Course::commit_updates(const vector<GroupUpdate> &updates)
+{
+    if (remerge_users(updates)) return;
+
+    // the users get new ids, so their name order goes too
+    user_ids = StringInterner();
+    name_rank.clear();
+    usergroups.clear();
+    usergrsets.clear();
+    cells = CellMatrix();
+    for (int i = 0; i < int(groups.size()); ++i) {
+        merge_group(i, loaded[i]);
+    }
+}
+
+/*
+ * Re-reads the given groups, requires keep_groups. A group whose file
+ * cannot be read keeps its previous contents, is added to failed, if
+ * given, and false is returned.
+ */
+bool Course::update_groups(const vector<int> &changed, vector<int> *failed)
+{
+    PhaseTimer timer(profile, "update_groups");
+    if (!keep_groups) abort();
+    vector<GroupUpdate> updates;
+    bool result = true;
+    for (int index : changed) {
+        const GroupInfo &gi = groups[index];
+        unique_ptr<MappedFile> file;
+        GroupData data;
+        GroupUpdate update;
+        update.index = index;
+        bool ready;
+        if (!fetch_group(index, file, data, ready)) {
+            if (failed) failed->push_back(index);
+            result = false;
+            continue;
+        }
+        if (ready) {
+            row_index[index] = GroupRows();
+        } else {
+            auto wall = chrono::steady_clock::now();
+            double cpu = profile?cpu_time_ms(CLOCK_THREAD_CPUTIME_ID):0;
+            decode_update(update, file->view(), data);
+            if (profile && index < int(profile->groups.size())) {
+                Profile::Group &pg = profile->groups[index];
+                pg.source = "file";
+                pg.parse_ms = ms_since(wall);
+                pg.cpu_ms = cpu_time_ms(CLOCK_THREAD_CPUTIME_ID) - cpu;
+                pg.rows = data.users.size();
+                pg.cells = data.cells.size();
+                pg.merge_ms = 0;
+            }
+            if (cache) cache->store(gi.get_file(), gi.get_format(), *file, data);
+        }
+        data.own();
+        if (!update.partial) update.previous = make_shared<GroupData>(std::move(loaded[index]));
+        loaded[index] = std::move(data);
+        updates.push_back(std::move(update));
+    }
+    commit_updates(updates);
+    return result;
+}
+
+/*
+ * Replaces the contents of the named group with the given standings page,
+ * for callers which do not keep the pages in files. Groups not ingested
+ * this way or loaded by process_groups() are empty.
+ */
+bool Course::ingest_group(const string &name, string_view html)
+{
+    PhaseTimer timer(profile, "ingest_group " + name);
+    // the group names are distinct, so the tables are current if all are in
+    if (group_index.size() != int(groups.size())) freeze();
+    int index = group_index.find(name);
+    if (index < 0) {
+        fprintf(stderr, "group '%s' not found\n", name.c_str());
+        return false;
+    }
+    if (!keep_groups) {
+        if (user_ids.size() > 0) {
+            fprintf(stderr, "groups were processed without keeping them\n");
+            return false;
+        }
+        keep_groups = true;
+    }
+    loaded.resize(groups.size());
+    row_index.resize(groups.size());
+
+    GroupData data;
+    GroupUpdate update;
+    update.index = index;
+    decode_update(update, html, data);
+    data.own();
+    if (!update.partial) update.previous = make_shared<GroupData>(std::move(loaded[update.index]));
+    loaded[update.index] = std::move(data);
+    commit_updates(vector<GroupUpdate>(1, std::move(update)));
+    return true;
+}
+
+/*
+ * The problems, categories, grades and groups are fixed once the config
+ * is read: the lookups on the per-user and per-cell paths go through
+ * flat tables built here instead of the maps of the config.
+ */
+void Course::freeze()
+{
+    group_index.clear();
+    for (int i = 0; i < int(groups.size()); ++i) {
+        group_index.insert(groups[i].get_name(), i);
+    }
+    category_index.clear();
+    for (int i = 0; i < int(categories.size()); ++i) {
+        category_index.insert(categories[i].name, i);
+    }
+    grade_index.clear();
+    for (int i = 0; i < int(grades.size()); ++i) {
+        grade_index.insert(grades[i].name, i);
+    }
+    order_probs.clear();
+    for (const auto &pn : problem_order) {
+        if (auto mi = problems.find(pn); mi != problems.end()) order_probs.push_back(&mi->second);
+    }
+    id_probs.assign(problem_ids.size(), nullptr);
+    for (const auto &pi : problems) {
+        id_probs[pi.second.get_id()] = &pi.second;
+    }
+}
+
+void Course::get_shard_range(int &first, int &last) const
+{
+    int n = groups.size();
+    first = int((long long) n * shard_index / shard_count);
+    last = int((long long) n * (shard_index + 1) / shard_count);
+}
+
+/*
+ * A partial holds the course data merged from a contiguous range of the
+ * groups, so that merging the partials of all the ranges in the config
+ * order gives the same user and problem ids, memberships and cells as a
+ * single run. The layout (native byte order):
+ *   magic, version, group count, first and last group, group names,
+ *   problem names in the id order,
+ *   users in the id order: name, group indexes in the membership order,
+ *   cells of each user: count, then (problem, status, score).
+ */
+static const char PARTIAL_MAGIC[8] = { 'R', 'A', 'T', 'E', 'R', 'P', 'R', 'T' };
+static const uint32_t PARTIAL_VERSION = 1;
+
+template<class T>
+static void put_binary(OutputWriter &out, T v)
+{
+    out.write((const char *) &v, sizeof(v));
+}
+
+static void put_binary_str(OutputWriter &out, string_view s)
+{
+    put_binary<uint32_t>(out, s.size());
+    out << s;
+}
+
+bool Course::write_partial(OutputWriter &out) const
+{
+    PhaseTimer timer(profile, "write_partial");
+    int first, last;
+    get_shard_range(first, last);
+
+    out.write(PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+    put_binary<uint32_t>(out, PARTIAL_VERSION);
+    put_binary<uint32_t>(out, groups.size());
+    put_binary<uint32_t>(out, first);
+    put_binary<uint32_t>(out, last);
+    for (int i = first; i < last; ++i) {
+        put_binary_str(out, groups[i].get_name());
+    }
+
+    put_binary<uint32_t>(out, problem_ids.size());
+    for (int i = 0; i < problem_ids.size(); ++i) {
+        put_binary_str(out, problem_ids.get_name(i));
+    }
+
+    const int nusers = user_ids.size();
+    put_binary<uint32_t>(out, nusers);
+    vector<uint32_t> member;
+    for (int id = 0; id < nusers; ++id) {
+        put_binary_str(out, user_ids.get_name(id));
+        member.clear();
+        string_view names = usergroups[id];
+        while (!names.empty()) {
+            size_t sp = names.find(' ');
+            int g = group_index.find(names.substr(0, sp));
+            if (g < 0) abort();
+            member.push_back(g);
+            names = (sp == string_view::npos)?string_view():names.substr(sp + 1);
+        }
+        put_binary<uint32_t>(out, member.size());
+        for (uint32_t g : member) {
+            put_binary<uint32_t>(out, g);
+        }
+    }
+
+    const int ncols = min(cells.get_cols(), problem_ids.size());
+    for (int id = 0; id < nusers; ++id) {
+        uint32_t count = 0;
+        if (id < cells.get_rows()) {
+            for (int p = 0; p < ncols; ++p) {
+                if (cells.at(id, p).get_status() != CellStatus::EMPTY) ++count;
+            }
+        }
+        put_binary<uint32_t>(out, count);
+        for (int p = 0; count > 0 && p < ncols; ++p) {
+            const Cell &cc = cells.at(id, p);
+            if (cc.get_status() == CellStatus::EMPTY) continue;
+            put_binary<uint32_t>(out, p);
+            put_binary<uint8_t>(out, uint8_t(cc.get_status()));
+            put_binary<int32_t>(out, cc.get_score());
+        }
+    }
+    return out.is_ok();
+}
+
+/*
+ * Loads the course data from the partials written for all the group
+ * ranges of the same config, in place of process_groups(). The partials
+ * may come in any order; they are merged in the order of their ranges.
+ */
+bool Course::merge_partials(const vector<string> &paths)
+{
+    PhaseTimer timer(profile, "merge_partials");
+    freeze();
+
+    struct Partial
+    {
+        string path;
+        unique_ptr<MappedFile> file;
+        BinaryReader in;
+        uint32_t first = 0;
+        uint32_t last = 0;
+    };
+    vector<Partial> parts(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        Partial &pt = parts[i];
+        pt.path = paths[i];
+        pt.file = make_unique<MappedFile>();
+        if (!pt.file->open(pt.path)) return false;
+        pt.in.in = pt.file->view();
+        BinaryReader &r = pt.in;
+        string_view magic = r.in.substr(0, sizeof(PARTIAL_MAGIC));
+        r.pos = magic.size();
+        if (magic != string_view(PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC)) || r.get<uint32_t>() != PARTIAL_VERSION) {
+            fprintf(stderr, "'%s' is not a partial of this version\n", pt.path.c_str());
+            return false;
+        }
+        uint32_t ngroups = r.get<uint32_t>();
+        pt.first = r.get<uint32_t>();
+        pt.last = r.get<uint32_t>();
+        bool same = r.ok && ngroups == groups.size() && pt.first <= pt.last && pt.last <= ngroups;
+        for (uint32_t g = pt.first; same && g < pt.last; ++g) {
+            same = r.get_str() == groups[g].get_name() && r.ok;
+        }
+        if (!same) {
+            fprintf(stderr, "partial '%s' does not match the groups of the config\n", pt.path.c_str());
+            return false;
+        }
+    }
+
+    sort(parts.begin(), parts.end(), [](const Partial &a, const Partial &b) {
+        return a.first < b.first || (a.first == b.first && a.last < b.last);
+    });
+    uint32_t next = 0;
+    for (const auto &pt : parts) {
+        if (pt.first == pt.last) continue;
+        if (pt.first != next) {
+            uint32_t g = min(pt.first, next);
+            fprintf(stderr, "group '%s' is %s in the partials\n", groups[g].get_name().c_str(),
+                    pt.first < next ? "repeated" : "missing");
+            return false;
+        }
+        next = pt.last;
+    }
+    if (next != groups.size()) {
+        fprintf(stderr, "group '%s' is missing in the partials\n", groups[next].get_name().c_str());
+        return false;
+    }
+
+    vector<int> pids;
+    vector<int> uids;
+    auto apply = [&](BinaryReader &r) {
+        uint32_t nprobs = r.get<uint32_t>();
+        if (!r.ok || nprobs > r.in.size()) return false;
+        pids.resize(nprobs);
+        for (uint32_t i = 0; i < nprobs && r.ok; ++i) {
+            pids[i] = problem_ids.intern(r.get_str());
+        }
+
+        uint32_t nusers = r.get<uint32_t>();
+        if (!r.ok || nusers > r.in.size()) return false;
+        uids.resize(nusers);
+        for (uint32_t i = 0; i < nusers && r.ok; ++i) {
+            string_view name = r.get_str();
+            uint32_t nmember = r.get<uint32_t>();
+            if (!r.ok || nmember == 0 || nmember > r.in.size()) return false;
+            for (uint32_t m = 0; m < nmember && r.ok; ++m) {
+                uint32_t g = r.get<uint32_t>();
+                if (g >= groups.size()) return false;
+                uids[i] = add_user_group(name, g);
+            }
+        }
+        if (!r.ok) return false;
+
+        // same first-come rule as add_cell()
+        cells.resize(user_ids.size(), problem_ids.size());
+        for (uint32_t i = 0; i < nusers && r.ok; ++i) {
+            uint32_t count = r.get<uint32_t>();
+            if (!r.ok || count > nprobs) return false;
+            for (uint32_t k = 0; k < count && r.ok; ++k) {
+                uint32_t p = r.get<uint32_t>();
+                uint8_t status = r.get<uint8_t>();
+                int32_t score = r.get<int32_t>();
+                if (p >= nprobs || status > uint8_t(CellStatus::FULL)) return false;
+                Cell &cur = cells.at(uids[i], pids[p]);
+                if (cur.get_status() == CellStatus::EMPTY) cur = Cell(CellStatus(status), score);
+            }
+        }
+        return r.ok && r.pos == r.in.size();
+    };
+    for (auto &pt : parts) {
+        if (!apply(pt.in)) {
+            fprintf(stderr, "partial '%s' is corrupted\n", pt.path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void Course::assign_columns()
+{
+    PhaseTimer timer(profile, "assign_columns");
+    freeze();
+    // the results of a previous call are dropped
+    catinfos.clear();
+    problem_count = 0;
+    for (auto &g : grades) {
+        g.max_score = 0;
+        g.prob_count = 0;
+    }
+    for (auto &pi : problems) {
+        pi.second.set_column(-1);
+    }
+
+    // count categories; a category named twice is counted at its first spec
+    for (int i = 0; i < int(categories.size()); ++i) {
+        catinfos.push_back(CategoryInfo(i, categories[i].crediting, categories[i].grader));
+    }
+    vector<int> spec_cat(categories.size());
+    for (int i = 0; i < int(categories.size()); ++i) {
+        spec_cat[i] = category_index.find(categories[i].name);
+    }
+    for (const auto &pi : problems) {
+        int ci = category_index.find(pi.second.get_category());
+        if (ci >= 0) {
+            ++catinfos[ci].count;
+            int score = pi.second.get_score();
+            if (score > 0) {
+                catinfos[ci].max_score += score;
+            }
         }
     }
     for (int i = 0; i < int(categories.size()); ++i) {
-        CategoryInfo &cur = catinfos.find(categories[i].name)->second;
+        CategoryInfo &cur = catinfos[spec_cat[i]];
         problem_count += cur.count;
         if (cur.crediting) {
-            auto gii = grade_idx.find(cur.grader);
-            if (gii != grade_idx.end()) {
-                GradeInfo &grade_info = grades[gii->second];
+            int gi = grade_index.find(cur.grader);
+            if (gi >= 0) {
+                GradeInfo &grade_info = grades[gi];
                 grade_info.prob_count += cur.count;
                 grade_info.max_score += cur.max_score;
             }
         }
     }
     for (int i = 1; i < int(categories.size()); ++i) {
-        const CategoryInfo &prev = catinfos.find(categories[i - 1].name)->second;
-        CategoryInfo &cur = catinfos.find(categories[i].name)->second;
+        const CategoryInfo &prev = catinfos[spec_cat[i - 1]];
+        CategoryInfo &cur = catinfos[spec_cat[i]];
         cur.start_pos = prev.start_pos + prev.count;
         cur.current = cur.start_pos;
     }
 
     // assign columns to problems
     for (auto &pi : problems) {
-        auto ci = catinfos.find(pi.second.get_category());
-        if (ci != catinfos.end()) {
-            pi.second.set_column(ci->second.current);
-            ++ci->second.current;
+        int ci = category_index.find(pi.second.get_category());
+        if (ci >= 0) {
+            pi.second.set_column(catinfos[ci].current);
+            ++catinfos[ci].current;
         }
     }
 
+    // flat lookup tables for the aggregation
+    prob_cat.assign(problem_ids.size(), PROB_NOT_FOUND);
+    for (const auto &pi : problems) {
+        int ci = category_index.find(pi.second.get_category());
+        prob_cat[pi.second.get_id()] = (ci >= 0)?catinfos[ci].index:CAT_NOT_FOUND;
+    }
+    cat_grade.assign(categories.size(), -1);
+    for (int i = 0; i < int(categories.size()); ++i) {
+        cat_grade[i] = grade_index.find(categories[i].grader);
+    }
+
     /*
     cout << "Categories: " << endl;
     for (int i = 0; i < int(categories.size()); ++i) {
-        auto ci = catinfos.find(categories[i].name);
-        if (ci != catinfos.end()) {
-            cout << categories[i].name << " " << ci->second.count << " " << ci->second.start_pos << " " << ci->second.max_score << " " << ci->second.current << endl;
-        }
+        const CategoryInfo &ci = catinfos[category_index.find(categories[i].name)];
+        cout << categories[i].name << " " << ci.count << " " << ci.start_pos << " " << ci.max_score << " " << ci.current << endl;
     }
 
     cout << "Grades: " << endl;
@@ -760,462 +2161,1040 @@ void Course::assign_columns()
     */
 }
 
-struct SortByScore
+/*
+ * Computes all per-user sums, percentages and marks in one pass over
+ * the cell matrix. The renderer only reads the results.
+ */
+void Course::aggregate(vector<UserInfo> &users) const
 {
-    const Course &course;
+    const int ncols = cells.get_cols();
+    const int ncats = categories.size();
+    const int ngrads = grades.size();
+
+    // cells which cannot be counted are reported, as they were before
+    long long no_problem = 0;
+    long long no_category = 0;
+    for (int p = 0; p < ncols; ++p) {
+        if (prob_cat[p] >= 0) continue;
+        for (int id = 0; id < cells.get_rows(); ++id) {
+            const Cell &cc = cells.at(id, p);
+            if (cc.get_status() == CellStatus::EMPTY || cc.get_score() < 0) continue;
+            if (prob_cat[p] == PROB_NOT_FOUND) {
+                fprintf(stderr, "problem '%s' not found\n", problem_ids.get_name(p).c_str());
+                ++no_problem;
+            } else {
+                fprintf(stderr, "category '%s' not found\n", id_probs[p]->get_category().c_str());
+                ++no_category;
+            }
+        }
+    }
+    if (profile) {
+        profile->set_counter("cells problem not found", no_problem);
+        profile->set_counter("cells category not found", no_category);
+    }
+
+    const int *pcat = prob_cat.data();
+    for (int id = 0; id < cells.get_rows(); ++id) {
+        UserInfo &u = users[id];
+        int *score_by_cat = u.score_by_cat.data();
+        int *prob_by_cat = u.prob_by_cat.data();
+        const Cell *row = ncols > 0?&cells.at(id, 0):nullptr;
+        for (int p = 0; p < ncols; ++p) {
+            const int cat = pcat[p];
+            const int score = row[p].get_score();
+            if (cat < 0 || row[p].get_status() == CellStatus::EMPTY || score < 0) continue;
+            score_by_cat[cat] += score;
+            prob_by_cat[cat] += (row[p].get_status() == CellStatus::FULL);
+        }
 
-    SortByScore(const Course &course_) : course(course_) {}
+        u.total_score = 0;
+        u.total_prob = 0;
+        fill(u.score_by_grad.begin(), u.score_by_grad.end(), 0);
+        fill(u.prob_by_grad.begin(), u.prob_by_grad.end(), 0);
+        for (int c = 0; c < ncats; ++c) {
+            u.total_score += score_by_cat[c];
+            u.total_prob += prob_by_cat[c];
+            if (cat_grade[c] >= 0) {
+                u.score_by_grad[cat_grade[c]] += score_by_cat[c];
+                u.prob_by_grad[cat_grade[c]] += prob_by_cat[c];
+            }
+        }
 
-    bool operator()(const string &name1, const string &name2)
-    {
-        auto i1 = course.userinfos.find(name1);
-        if (i1 == course.userinfos.end()) abort();
-        const UserInfo &u1 = i1->second;
-        auto i2 = course.userinfos.find(name2);
-        if (i2 == course.userinfos.end()) abort();
-        const UserInfo &u2 = i2->second;
-
-        if (u1.total_score > u2.total_score) return true;
-        if (u1.total_score < u2.total_score) return false;
-        if (u1.total_prob > u2.total_prob) return true;
-        if (u1.total_prob < u2.total_prob) return false;
-        if (u1.group < u2.group) return true;
-        if (u1.group > u2.group) return false;
-        return u1.name < u2.name;
+        u.grad_summ = 0;
+        for (int i = 0; i < ngrads; ++i) {
+            int perc1 = 0;
+            if (grades[i].max_score > 0) {
+                perc1 = (u.score_by_grad[i] * 100LL + grades[i].max_score - 1) / grades[i].max_score;
+            }
+            u.perc_by_grad[i] = perc1;
+            if (perc1 < 0) perc1 = 0;
+            if (perc1 > 100) perc1 = 100;
+            int mark = grades[i].marks[perc1];
+            if (mark < 0) mark = 0;
+            u.mark_by_grad[i] = mark;
+            u.grad_summ += mark;
+        }
     }
+}
+
+/*
+ * Packed sort key of a user: the two totals in the configured order,
+ * descending, then the group rank and the name rank, ascending. Keys
+ * compare as 128-bit unsigned numbers, equal 'hi' means a shared place.
+ */
+struct RatingKey
+{
+    uint64_t hi;
+    uint64_t lo;
+    int id;
 };
-struct SortByProblems
+
+// maps a signed value to an unsigned one of the same order
+static uint32_t order_bits(int v)
 {
-    const Course &course;
+    return uint32_t(v) ^ 0x80000000U;
+}
 
-    SortByProblems(const Course &course_) : course(course_) {}
+/*
+ * LSD radix sort of the keys, a byte at a time; the passes in which all
+ * keys have the same byte are skipped.
+ */
+static void radix_sort_keys(vector<RatingKey> &keys)
+{
+    vector<RatingKey> tmp(keys.size());
+    size_t count[256];
+    for (int pass = 0; pass < 16; ++pass) {
+        const int shift = (pass % 8) * 8;
+        const bool high = pass >= 8;
+        memset(count, 0, sizeof(count));
+        for (const auto &k : keys) {
+            ++count[((high ? k.hi : k.lo) >> shift) & 0xff];
+        }
+        if (keys.empty() || count[((high ? keys[0].hi : keys[0].lo) >> shift) & 0xff] == keys.size()) continue;
+        size_t pos = 0;
+        for (auto &c : count) {
+            size_t n = c;
+            c = pos;
+            pos += n;
+        }
+        for (const auto &k : keys) {
+            tmp[count[((high ? k.hi : k.lo) >> shift) & 0xff]++] = k;
+        }
+        keys.swap(tmp);
+    }
+}
 
-    bool operator()(const string &name1, const string &name2)
-    {
-        auto i1 = course.userinfos.find(name1);
-        if (i1 == course.userinfos.end()) abort();
-        const UserInfo &u1 = i1->second;
-        auto i2 = course.userinfos.find(name2);
-        if (i2 == course.userinfos.end()) abort();
-        const UserInfo &u2 = i2->second;
-
-        if (u1.total_prob > u2.total_prob) return true;
-        if (u1.total_prob < u2.total_prob) return false;
-        if (u1.total_score > u2.total_score) return true;
-        if (u1.total_score < u2.total_score) return false;
-        if (u1.group < u2.group) return true;
-        if (u1.group > u2.group) return false;
-        return u1.name < u2.name;
+/*
+ * Group statistics of the rating. Every group a rated user belongs to
+ * counts the user once, and so does "All" for every such membership,
+ * with the running number of the membership as the place. Large ratings
+ * are cut into parts whose partial statistics are collected by separate
+ * threads and merged in order.
+ */
+void Course::compute_group_stats(RatingResult &r) const
+{
+    const vector<int> &order = r.order;
+    const int nusers = order.size();
+    const int ngroups = groups.size();
+
+    // group indexes of the memberships, by position in the rating
+    vector<int> member_begin(nusers + 1);
+    vector<int> member_groups;
+    for (int i = 0; i < nusers; ++i) {
+        member_begin[i] = member_groups.size();
+        int id = order[i];
+        if (r.users[id].total_prob <= 0) continue;
+        member_groups.insert(member_groups.end(), usergrsets[id].begin(), usergrsets[id].end());
+    }
+    member_begin[nusers] = member_groups.size();
+
+    int nparts = 1;
+    int workers = get_worker_count();
+    if (workers > 1 && nusers >= 2 * STATS_PART_SIZE) nparts = min(workers, nusers / STATS_PART_SIZE);
+    auto part_begin = [&](int k) { return int((long long) nusers * k / nparts); };
+
+    // first[k][g]: memberships of group g before part k; g == ngroups is "All"
+    vector<vector<long long> > first(nparts + 1, vector<long long>(ngroups + 1));
+    for (int k = 0; k < nparts; ++k) {
+        first[k + 1] = first[k];
+        for (int m = member_begin[part_begin(k)]; m < member_begin[part_begin(k + 1)]; ++m) {
+            ++first[k + 1][member_groups[m]];
+            ++first[k + 1][ngroups];
+        }
     }
-};
+    const vector<long long> &total = first[nparts];
+
+    vector<vector<GroupInfo> > partial(nparts);
+    auto collect = [&](int k) {
+        vector<GroupInfo> &part = partial[k];
+        part = groups;
+        part.push_back(r.group_all);
+        for (int g = 0; g <= ngroups; ++g) {
+            part[g].clear_stats();
+            part[g].expect(total[g], first[k][g], max_score, problem_count);
+        }
+        long long serial = first[k][ngroups];
+        for (int i = part_begin(k); i < part_begin(k + 1); ++i) {
+            const UserInfo &u = r.users[order[i]];
+            for (int m = member_begin[i]; m < member_begin[i + 1]; ++m) {
+                ++serial;
+                part[ngroups].add_stat(serial, u.total_score, u.total_prob);
+                part[member_groups[m]].add_stat(serial, u.total_score, u.total_prob);
+            }
+        }
+    };
+    vector<thread> threads;
+    for (int k = 1; k < nparts; ++k) {
+        threads.emplace_back(collect, k);
+    }
+    collect(0);
+    for (auto &t : threads) t.join();
+
+    r.groups = groups;
+    for (int g = 0; g <= ngroups; ++g) {
+        GroupInfo &gi = g < ngroups ? r.groups[g] : r.group_all;
+        gi.clear_stats();
+        gi.expect(total[g], 0, max_score, problem_count);
+        for (int k = 0; k < nparts; ++k) {
+            gi.merge(partial[k][g]);
+        }
+    }
+}
+
+/*
+ * Per-problem results for every group and overall. The problems are
+ * split among the worker threads, each thread walks the user rows once
+ * and updates the statistics of its own problems only, the histogram by
+ * tenths of the full score included.
+ */
+void Course::compute_problem_stats(RatingResult &r) const
+{
+    const int nusers = user_ids.size();
+    const int ngroups = groups.size();
+
+    const vector<const ProblemInfo *> &probs = order_probs;
+    const int nprobs = probs.size();
+
+    r.problems.resize(nprobs);
+    for (int k = 0; k < nprobs; ++k) {
+        ProblemSummary &ps = r.problems[k];
+        ps.name = probs[k]->get_name();
+        ps.score = probs[k]->get_score();
+        ps.all.scores = IntStats(true, max(ps.score, 0));
+        ps.groups.assign(ngroups, ps.all);
+    }
+
+    // the tenth of the full score a score falls in
+    auto tenth = [](int score, int full) { return full > 0 ? min(9, int((long long) score * 10 / full)) : 0; };
+    auto add = [&](ProblemStats &st, const Cell &cc, int full) {
+        ++st.attempted;
+        if (cc.get_status() == CellStatus::FULL) ++st.solved;
+        st.max_score = max(st.max_score, cc.get_score());
+        st.scores.add(cc.get_score());
+        if (full > 0) ++st.tenths[tenth(cc.get_score(), full)];
+    };
+    auto collect = [&](int first, int last) {
+        for (int id = 0; id < nusers; ++id) {
+            for (int k = first; k < last; ++k) {
+                if (probs[k]->get_column() < 0) continue;
+                const Cell &cc = cells.at(id, probs[k]->get_id());
+                if (cc.get_status() == CellStatus::EMPTY || cc.get_score() < 0) continue;
+                ProblemSummary &ps = r.problems[k];
+                add(ps.all, cc, ps.score);
+                for (int g : usergrsets[id]) {
+                    add(ps.groups[g], cc, ps.score);
+                }
+            }
+        }
+    };
+
+    int nthreads = min(get_worker_count(), nprobs);
+    if (nusers < STATS_PART_SIZE) nthreads = 1;
+    vector<thread> threads;
+    for (int t = 1; t < nthreads; ++t) {
+        threads.emplace_back(collect, nprobs * t / nthreads, nprobs * (t + 1) / nthreads);
+    }
+    collect(0, nthreads > 0 ? nprobs / nthreads : nprobs);
+    for (auto &t : threads) t.join();
+
+    // the problems without a full score in the config are split by the
+    // tenths of their largest score, which is known only now
+    vector<int> unscored;
+    for (int k = 0; k < nprobs; ++k) {
+        if (r.problems[k].score <= 0 && probs[k]->get_column() >= 0) unscored.push_back(k);
+    }
+    if (unscored.empty()) return;
+    for (int id = 0; id < nusers; ++id) {
+        for (int k : unscored) {
+            const Cell &cc = cells.at(id, probs[k]->get_id());
+            if (cc.get_status() == CellStatus::EMPTY || cc.get_score() < 0) continue;
+            ProblemSummary &ps = r.problems[k];
+            ++ps.all.tenths[tenth(cc.get_score(), ps.all.max_score)];
+            for (int g : usergrsets[id]) {
+                ++ps.groups[g].tenths[tenth(cc.get_score(), ps.groups[g].max_score)];
+            }
+        }
+    }
+}
 
-void Course::assign_users()
+/*
+ * Computes the rating: per-user sums and marks, the rating order, place
+ * ranges and group statistics.
+ */
+RatingResult Course::compute()
 {
-    for (const auto &nn : usergroups) {
-        userinfos.insert(make_pair(nn.first, UserInfo(nn.first, nn.second, problem_count, categories.size(), grades.size())));
+    RatingResult r;
+    {
+        PhaseTimer timer(profile, "aggregate");
+        r.users.reserve(user_ids.size());
+        for (int id = 0; id < user_ids.size(); ++id) {
+            r.users.push_back(UserInfo(user_ids.get_name(id), usergroups[id], categories.size(), grades.size()));
+        }
+        cells.resize(user_ids.size(), problem_ids.size());
+        // problems first seen after assign_columns() are not counted
+        prob_cat.resize(problem_ids.size(), PROB_NOT_FOUND);
+
+        aggregate(r.users);
     }
 
-    for (const auto &cl : cells) {
-        const auto &ci = cl.first;
-        const auto &cc = cl.second;
-        if (cc.get_status() == CellStatus::EMPTY) continue;
-        if (cc.get_score() < 0) continue;
-        const string &user = ci.get_user();
-        const string &problem = ci.get_problem();
-        auto uii = userinfos.find(user);
-        if (uii == userinfos.end()) {
-            fprintf(stderr, "userinfo '%s' not found\n", user.c_str());
-            abort();
+    vector<int> &usernames = r.order;
+    vector<RatingKey> keys;
+    {
+        PhaseTimer timer(profile, "sort");
+        const int nusers = r.users.size();
+
+        // the ranks of the user names are kept while the user ids stay,
+        // commit_updates() drops them when it renumbers the users
+        if (int(name_rank.size()) != nusers) {
+            // the names are radix sorted by their first 16 bytes, and by
+            // the rest where those are equal
+            vector<RatingKey> by_name(nusers);
+            for (int id = 0; id < nusers; ++id) {
+                const string &name = user_ids.get_name(id);
+                uint64_t prefix[2] = { 0, 0 };
+                for (int i = 0; i < 16; ++i) {
+                    prefix[i / 8] = prefix[i / 8] << 8 | (i < int(name.size()) ? (unsigned char) name[i] : 0);
+                }
+                by_name[id] = RatingKey{prefix[0], prefix[1], id};
+            }
+            radix_sort_keys(by_name);
+            for (int first = 0, last = 0; first < nusers; first = last) {
+                ++last;
+                while (last < nusers && by_name[last].hi == by_name[first].hi && by_name[last].lo == by_name[first].lo) ++last;
+                if (last - first < 2) continue;
+                sort(by_name.begin() + first, by_name.begin() + last, [this](const RatingKey &a, const RatingKey &b) {
+                    return string_view(user_ids.get_name(a.id)).substr(16) < string_view(user_ids.get_name(b.id)).substr(16);
+                });
+            }
+            name_rank.resize(nusers);
+            for (int i = 0; i < nusers; ++i) name_rank[by_name[i].id] = i;
         }
-        UserInfo &user_info = uii->second;
-        auto pii = problems.find(problem);
-        if (pii == problems.end()) {
-            fprintf(stderr, "problem '%s' not found\n", problem.c_str());
-            continue;
+
+        // the group lists of the users take only a few distinct values
+        unordered_map<string_view, int> group_rank;
+        vector<const int *> user_group_rank(nusers);
+        for (int id = 0; id < nusers; ++id) {
+            user_group_rank[id] = &group_rank.try_emplace(usergroups[id], 0).first->second;
         }
-        ProblemInfo &prob_info = pii->second;
-        auto cii = catinfos.find(prob_info.get_category());
-        if (cii == catinfos.end()) {
-            fprintf(stderr, "category '%s' not found\n", prob_info.get_category().c_str());
-            continue;
+        vector<string_view> group_names;
+        for (const auto &gr : group_rank) group_names.push_back(gr.first);
+        sort(group_names.begin(), group_names.end());
+        for (int i = 0; i < int(group_names.size()); ++i) group_rank[group_names[i]] = i;
+
+        keys.resize(nusers);
+        for (int id = 0; id < nusers; ++id) {
+            const UserInfo &u = r.users[id];
+            int first = u.total_score;
+            int second = u.total_prob;
+            if (sort_mode == 1) swap(first, second);
+            keys[id].hi = uint64_t(~order_bits(first)) << 32 | uint32_t(~order_bits(second));
+            keys[id].lo = uint64_t(*user_group_rank[id]) << 32 | uint32_t(name_rank[id]);
+            keys[id].id = id;
+        }
+        radix_sort_keys(keys);
+
+        usernames.resize(nusers);
+        for (int i = 0; i < nusers; ++i) usernames[i] = keys[i].id;
+    }
+
+    {
+        PhaseTimer timer(profile, "statistics");
+        // users with equal scores share a place range
+        r.places.resize(usernames.size());
+        for (int first = 0, last = 0; first < int(keys.size()); first = last) {
+            while (last < int(keys.size()) && keys[last].hi == keys[first].hi) ++last;
+            string range = to_string(first + 1);
+            if (last > first + 1) range += "-" + to_string(last);
+            for (int i = first; i < last; ++i) r.places[i] = range;
         }
-        CategoryInfo &cat_info = cii->second;
-        user_info.row[prob_info.get_column()] = cc;
-        user_info.score_by_cat[cat_info.index] += cc.get_score();
-        user_info.total_score += cc.get_score();
-        if (cc.get_status() == CellStatus::FULL) {
-            ++user_info.prob_by_cat[cat_info.index];
-            ++user_info.total_prob;
+
+        compute_group_stats(r);
+        if (show_problem_statistics) compute_problem_stats(r);
+
+        int best_score = 0;
+        for (int id : usernames) {
+            const UserInfo &u = r.users[id];
+            if (u.total_score > best_score)
+                best_score = u.total_score;
         }
-        auto gii = grade_idx.find(cat_info.grader);
-        if (gii != grade_idx.end()) {
-            //GradeInfo &grad_info = grades[gii->second];
-            user_info.score_by_grad[gii->second] += cc.get_score();
-            if (cc.get_status() == CellStatus::FULL) {
-                ++user_info.prob_by_grad[gii->second];
+        if (best_score <= 0) best_score = 100;
+        r.best_score = best_score;
+
+        r.cells = cells;
+    }
+
+    if (profile) {
+        long long filled = 0;
+        for (int i = 0; i < cells.get_rows(); ++i) {
+            for (int j = 0; j < cells.get_cols(); ++j) {
+                if (cells.at(i, j).get_status() != CellStatus::EMPTY) ++filled;
             }
         }
+        long long memberships = 0;
+        for (const auto &gs : usergrsets) memberships += gs.size();
+        profile->set_counter("users", user_ids.size());
+        profile->set_counter("problem ids", problem_ids.size());
+        profile->set_counter("group memberships", memberships);
+        profile->set_counter("matrix cells", (long long) cells.get_rows() * cells.get_cols());
+        profile->set_counter("filled cells", filled);
+        profile->set_counter("rated users", r.order.size());
+    }
+    return r;
+}
+
+void write_json_string(OutputWriter &out, string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+    out << '"';
+    size_t start = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out << s.substr(start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            out << "\\u00" << hex[c >> 4] << hex[c & 15];
+            break;
+        }
     }
+    out << s.substr(start) << '"';
+}
 
-    vector<string> usernames;
-    for (const auto &ui : userinfos) {
-        usernames.push_back(ui.second.name);
+static void write_html_attr(OutputWriter &out, string_view s)
+{
+    out << '"';
+    size_t start = 0;
+    for (size_t p; (p = s.find_first_of("&\"<>", start)) != string_view::npos; start = p + 1) {
+        out << s.substr(start, p - start);
+        switch (s[p]) {
+        case '&': out << "&amp;"; break;
+        case '"': out << "&quot;"; break;
+        case '<': out << "&lt;"; break;
+        default: out << "&gt;"; break;
+        }
     }
-    if (sort_mode == 1) {
-        sort(usernames.begin(), usernames.end(), SortByProblems(*this));
-    } else {
-        sort(usernames.begin(), usernames.end(), SortByScore(*this));
+    out << s.substr(start) << '"';
+}
+
+// quoted only when needed, as in RFC 4180
+static void write_csv_field(OutputWriter &out, string_view s)
+{
+    if (s.find_first_of(",\"\r\n") == string_view::npos) {
+        out << s;
+        return;
+    }
+    out << '"';
+    size_t start = 0;
+    for (size_t p; (p = s.find('"', start)) != string_view::npos; start = p + 1) {
+        out << s.substr(start, p + 1 - start) << '"';
     }
+    out << s.substr(start) << '"';
+}
+
+void Course::render_json_head(OutputWriter &out) const
+{
+    out << "{\n\"max_score\": " << max_score << ",\n\"problems\": [";
+    const char *sep = "";
+    for (const ProblemInfo *pp : order_probs) {
+        out << sep << "{\"name\": ";
+        write_json_string(out, pp->get_name());
+        out << ", \"score\": " << pp->get_score() << ", \"category\": ";
+        write_json_string(out, pp->get_category());
+        out << '}';
+        sep = ", ";
+    }
+    out << "],\n\"categories\": [";
+    for (int i = 0; i < int(categories.size()); ++i) {
+        if (i > 0) out << ", ";
+        write_json_string(out, categories[i].name);
+    }
+    out << "],\n\"grades\": [";
+    for (int i = 0; i < int(grades.size()); ++i) {
+        if (i > 0) out << ", ";
+        write_json_string(out, grades[i].name);
+    }
+    out << "],\n\"users\": [";
+}
 
-    int serial = 0;
-    for (const auto &name : usernames) {
-        auto ui = userinfos.find(name);
-        if (ui == userinfos.end()) abort();
-        const UserInfo &u = ui->second;
-        if (u.total_prob <= 0) continue;
-        auto ugi = usergrsets.find(name);
-        if (ugi == usergrsets.end()) abort();
-        const set<string> &grps = ugi->second;
-        for (const auto grpn : grps) {
-            auto gi = groupidx.find(grpn);
-            if (gi == groupidx.end()) abort();
-            GroupInfo &g = groups[gi->second];
-            group_all.add_stat(++serial, u.total_score, u.total_prob);
-            g.add_stat(serial, u.total_score, u.total_prob);
+void Course::render_json_user(const RatingResult &r, int nindex, OutputWriter &out) const
+{
+    const int id = r.order[nindex];
+    const UserInfo &u = r.users[id];
+
+    out << (nindex > 0 ? ",\n" : "\n") << "{\"place\": ";
+    write_json_string(out, r.places[nindex]);
+    out << ", \"name\": ";
+    write_json_string(out, u.name);
+    out << ", \"group\": ";
+    write_json_string(out, u.group);
+    out << ", \"score\": " << u.total_score << ", \"problems\": " << u.total_prob;
+    out << ", \"cells\": [";
+    const char *sep = "";
+    for (const ProblemInfo *pp : order_probs) {
+        const ProblemInfo &prob_info = *pp;
+        const Cell empty;
+        const auto &cc = (prob_info.get_column() >= 0)?r.cells.at(id, prob_info.get_id()):empty;
+        out << sep;
+        sep = ", ";
+        if (cc.get_status() == CellStatus::EMPTY) {
+            out << "null";
+        } else {
+            out << "{\"score\": " << cc.get_score() << ", \"full\": "
+                << (cc.get_status() == CellStatus::FULL ? "true" : "false") << '}';
         }
     }
+    out << "], \"categories\": [";
+    for (int i = 0; i < int(u.score_by_cat.size()); ++i) {
+        if (i > 0) out << ", ";
+        out << "{\"score\": " << u.score_by_cat[i] << ", \"problems\": " << u.prob_by_cat[i] << '}';
+    }
+    out << "], \"grades\": [";
+    for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
+        if (i > 0) out << ", ";
+        out << "{\"score\": " << u.score_by_grad[i] << ", \"percent\": " << u.perc_by_grad[i]
+            << ", \"problems\": " << u.prob_by_grad[i] << ", \"mark\": " << u.mark_by_grad[i] << '}';
+    }
+    out << "]}";
+}
 
-    int best_score = 0;
-    for (const auto &name : usernames) {
-        auto ui = userinfos.find(name);
-        if (ui == userinfos.end()) abort();
-        UserInfo &u = ui->second;
-        if (u.total_score > best_score)
-            best_score = u.total_score;
+void Course::render_csv_head(OutputWriter &out) const
+{
+    out << "Place,Name,Group,Score,Problems";
+    for (const ProblemInfo *pp : order_probs) {
+        out << ',';
+        write_csv_field(out, pp->get_name());
+    }
+    for (int i = 0; i < int(categories.size()); ++i) {
+        for (const char *col : { " S", " P" }) {
+            out << ',';
+            write_csv_field(out, categories[i].name + col);
+        }
+    }
+    for (int i = 0; i < int(grades.size()); ++i) {
+        for (const char *col : { " S", " %", " P", " M" }) {
+            out << ',';
+            write_csv_field(out, grades[i].name + col);
+        }
     }
-    if (best_score <= 0) best_score = 100;
+    out << "\r\n";
+}
+
+void Course::render_csv_user(const RatingResult &r, int nindex, OutputWriter &out) const
+{
+    const int id = r.order[nindex];
+    const UserInfo &u = r.users[id];
+
+    write_csv_field(out, r.places[nindex]);
+    out << ',';
+    write_csv_field(out, u.name);
+    out << ',';
+    write_csv_field(out, u.group);
+    out << ',' << u.total_score << ',' << u.total_prob;
+    for (const ProblemInfo *pp : order_probs) {
+        const ProblemInfo &prob_info = *pp;
+        const Cell empty;
+        const auto &cc = (prob_info.get_column() >= 0)?r.cells.at(id, prob_info.get_id()):empty;
+        out << ',';
+        if (cc.get_status() != CellStatus::EMPTY) out << cc.get_score();
+    }
+    for (int i = 0; i < int(u.score_by_cat.size()); ++i) {
+        out << ',' << u.score_by_cat[i] << ',' << u.prob_by_cat[i];
+    }
+    for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
+        out << ',' << u.score_by_grad[i] << ',' << u.perc_by_grad[i]
+            << ',' << u.prob_by_grad[i] << ',' << u.mark_by_grad[i];
+    }
+    out << "\r\n";
+}
 
+/*
+ * Writes the rating page. The parts taken from the header, notes and
+ * footer files return false if those cannot be read.
+ */
+bool Course::render_page_head(OutputWriter &out) const
+{
     if (header_name.size() > 0) {
-        cout << read_file(header_name);
+        if (!copy_file(out, header_name)) return false;
     } else {
-        cout << "<html>" << endl;
-        cout << "<head>" << endl;
-        cout << "<meta http-equiv=\"Content-type\" content=\"text/html; charset=UTF-8\">" << endl;
-        cout << "<style>" << endl;
-        cout << "tbody tr:nth-child(even) { background-color: #dddddd; }" << endl;
-        cout << "tbody tr:nth-child(odd) { background-color: white; }" << endl;
-        cout << "</style>" << endl;
-        cout << "</head>" << endl;
-        cout << "<body>" << endl;
-        cout << "<script src=\"sorttable.js\"></script>" << endl;
-    }
-    cout << "<h1>Rating</h1>" << endl;
-    cout << "<table class=\"sortable\" border=\"1\">" << endl;
-    cout << "<thead>" << endl;
+        out << "<html>" << '\n';
+        out << "<head>" << '\n';
+        out << "<meta http-equiv=\"Content-type\" content=\"text/html; charset=UTF-8\">" << '\n';
+        out << "<style>" << '\n';
+        out << "tbody tr:nth-child(even) { background-color: #dddddd; }" << '\n';
+        out << "tbody tr:nth-child(odd) { background-color: white; }" << '\n';
+        out << "</style>" << '\n';
+        out << "</head>" << '\n';
+        out << "<body>" << '\n';
+        out << "<script src=\"sorttable.js\"></script>" << '\n';
+    }
+    return true;
+}
+
+/*
+ * The rating table of the given positions in the rating order, or of all
+ * the users if rows is null.
+ */
+void Course::render_table(const RatingResult &r, const vector<int> *rows, OutputWriter &out,
+                          OutputWriter *json, OutputWriter *csv) const
+{
+    out << "<table class=\"sortable\" border=\"1\"";
+    if (!live_tag.empty()) {
+        out << " data-live=";
+        write_html_attr(out, live_tag);
+    }
+    out << ">" << '\n';
+    out << "<thead>" << '\n';
+    render_table_head(out);
+    out << "</thead>" << '\n';
+    out << "<tbody>" << '\n';
+    const int nrows = rows ? int(rows->size()) : int(r.order.size());
+    for (int k = 0; k < nrows; ++k) {
+        const int nindex = rows ? (*rows)[k] : k;
+
+        if (live_tag.empty()) {
+            out << "<tr>" << '\n';
+        } else {
+            out << "<tr data-user=";
+            write_html_attr(out, r.users[r.order[nindex]].name);
+            out << ">" << '\n';
+        }
+        out << "<td>" << r.places[nindex] << "</td>";
+        render_row_cells(r, nindex, out);
+        out << "</tr>\n\n";
+
+        if (json) render_json_user(r, nindex, *json);
+        if (csv) render_csv_user(r, nindex, *csv);
+    }
+    out << "</tbody>" << '\n';
+    if (json) *json << "\n]\n}\n";
+    out << "</table>" << '\n';
+    if (!live_tag.empty()) {
+        out << "<script src=\"rater-live.js\"></script>" << '\n';
+    }
+}
+
+void Course::render_table_head(OutputWriter &out) const
+{
     /*
-    cout << "<tr>" << endl;
-    cout << "<th rowspan=\"2\">N</th>" << endl;
-    cout << "<th rowspan=\"2\">Name</th>" << endl;
-    cout << "<th rowspan=\"2\">Group</th>" << endl;
-    cout << "<th rowspan=\"2\">Total<br/>Score</th>" << endl;
-    cout << "<th rowspan=\"2\">Total<br/>Probs</th>" << endl;
+    out << "<tr>" << '\n';
+    out << "<th rowspan=\"2\">N</th>" << '\n';
+    out << "<th rowspan=\"2\">Name</th>" << '\n';
+    out << "<th rowspan=\"2\">Group</th>" << '\n';
+    out << "<th rowspan=\"2\">Total<br/>Score</th>" << '\n';
+    out << "<th rowspan=\"2\">Total<br/>Probs</th>" << '\n';
     if (show_problems) {
         for (const auto &pii : problems) {
-            cout << "<th rowspan=\"2\">" << pii.first << "</th>" << endl;
+            out << "<th rowspan=\"2\">" << pii.first << "</th>" << '\n';
         }
     }
     if (show_accumulated) {
-        cout << "<th rowspan=\"2\">Accum</th>" << endl;
+        out << "<th rowspan=\"2\">Accum</th>" << '\n';
     }
     if (!hide_summary) {
         if (!hide_marks) {
-            cout << "<th rowspan=\"2\" colspan=\"" << grades.size() << "\">Marks</th>" << endl;
+            out << "<th rowspan=\"2\" colspan=\"" << grades.size() << "\">Marks</th>" << '\n';
         }
-        cout << "<th colspan=\"" << (categories.size() * 2) << "\">Categories</th>" << endl;
+        out << "<th colspan=\"" << (categories.size() * 2) << "\">Categories</th>" << '\n';
         if (!hide_marks) {
-            cout << "<th colspan=\"" << (grades.size() * 3) << "\">Grades</th>" << endl;
+            out << "<th colspan=\"" << (grades.size() * 3) << "\">Grades</th>" << '\n';
         }
     }
-    cout << "</tr>" << endl;
-    cout << "<tr>" << endl;
+    out << "</tr>" << '\n';
+    out << "<tr>" << '\n';
     if (!hide_summary) {
         for (int i = 0; i < int(categories.size()); ++i) {
-            auto ii = catinfos.find(categories[i].name);
-            if (ii != catinfos.end()) {
-                //const CategoryInfo &ci = ii->second;
-                cout << "<th colspan=\"2\">" << categories[i].name << "</th>";
-            }
+            out << "<th colspan=\"2\">" << categories[i].name << "</th>";
         }
         if (!hide_marks) {
             for (int i = 0; i < int(grades.size()); ++i) {
-                cout << "<th colspan=\"3\">" << grades[i].name << "</th>";
+                out << "<th colspan=\"3\">" << grades[i].name << "</th>";
             }
         }
     }
-    cout << "</tr>" << endl;
+    out << "</tr>" << '\n';
     */
-    cout << "<tr>" << endl;
-    cout << "<th>N</th>" << endl;
-    cout << "<th>Name</th>" << endl;
+    out << "<tr>" << '\n';
+    out << "<th>N</th>" << '\n';
+    out << "<th>Name</th>" << '\n';
     if (!hide_group) {
-        cout << "<th>Group</th>" << endl;
+        out << "<th>Group</th>" << '\n';
     }
-    cout << "<th title=\"Total Score\">T. S.</th>" << endl;
+    out << "<th title=\"Total Score\">T. S.</th>" << '\n';
     if (show_percent) {
-        cout << "<th>%</th>" << endl;
+        out << "<th>%</th>" << '\n';
     }
-    cout << "<th title=\"Total Problems\">T. P.</th>" << endl;
+    out << "<th title=\"Total Problems\">T. P.</th>" << '\n';
     if (show_problems) {
-        for (const auto &pn : problem_order) {
-            if (auto mi = problems.find(pn); mi != problems.end()) {
-                cout << "<th>" << mi->first << "</th>" << endl;
-            }
+        for (const ProblemInfo *pp : order_probs) {
+            out << "<th>" << pp->get_name() << "</th>" << '\n';
         }
     }
     if (show_accumulated) {
-        cout << "<th>Accum</th>" << endl;
+        out << "<th>Accum</th>" << '\n';
     }
     if (!hide_summary) {
         if (!hide_grades) {
             for (int i = 0; i < int(grades.size()); ++i) {
-                cout << "<th>" << grades[i].name << " (" << grades[i].marks[100] << ")</th>";
+                out << "<th>" << grades[i].name << " (" << grades[i].marks[100] << ")</th>";
             }
         }
         for (int i = 0; i < int(categories.size()); ++i) {
-            auto ii = catinfos.find(categories[i].name);
-            if (ii != catinfos.end()) {
-                const CategoryInfo &ci = ii->second;
-                cout << "<th>" << categories[i].name << " S (" << ci.max_score << ")</th>";
-                cout << "<th>" << categories[i].name << " P (" << ci.count << ")</th>";
-            }
+            const CategoryInfo &ci = catinfos[category_index.find(categories[i].name)];
+            out << "<th>" << categories[i].name << " S (" << ci.max_score << ")</th>";
+            out << "<th>" << categories[i].name << " P (" << ci.count << ")</th>";
         }
         if (!hide_marks) {
             for (int i = 0; i < int(grades.size()); ++i) {
-                cout << "<th>" << grades[i].name << " S (" << grades[i].max_score << ")</th>";
-                cout << "<th>" << grades[i].name << " P (" << grades[i].prob_count << ")</th>";
+                out << "<th>" << grades[i].name << " S (" << grades[i].max_score << ")</th>";
+                out << "<th>" << grades[i].name << " P (" << grades[i].prob_count << ")</th>";
                 if (!hide_grades) {
-                    cout << "<th>" << grades[i].name << " M (" << grades[i].marks[100] << ")</th>";
+                    out << "<th>" << grades[i].name << " M (" << grades[i].marks[100] << ")</th>";
                 }
             }
         }
     }
-    cout << "</tr>" << endl;
-    cout << "</thead>" << endl;
-    cout << "<tbody>" << endl;
-    serial = 0;
-    int prev_grade = -1;
-    int prev_grade_2 = -1;
-    string prev_grade_str;
-    for (int nindex = 0; nindex < int(usernames.size()); ++nindex) {
-        const auto &name = usernames[nindex];
-        auto ui = userinfos.find(name);
-        if (ui == userinfos.end()) abort();
-        UserInfo &u = ui->second;
-
-        cout << "<tr>" << endl;
-        int cur_grade = u.total_score;
-        int cur_grade_2 = u.total_prob;
-        if (sort_mode == 1) {
-            cur_grade = u.total_prob;
-            cur_grade_2 = u.total_score;
-        }
-        if (!nindex || cur_grade != prev_grade || cur_grade_2 != prev_grade_2) {
-            prev_grade = cur_grade;
-            prev_grade_2 = cur_grade_2;
-            int endind = nindex + 1;
-            for (; endind < int(usernames.size()); ++endind) {
-                auto nui = userinfos.find(usernames[endind]);
-                if (nui == userinfos.end()) abort();
-                UserInfo &nu = nui->second;
-                int next_grade = nu.total_score;
-                int next_grade_2 = nu.total_prob;
-                if (sort_mode == 1) {
-                    next_grade = nu.total_prob;
-                    next_grade_2 = nu.total_score;
-                }
-                if (next_grade != prev_grade || next_grade_2 != prev_grade_2) break;
-            }
-            if (endind == nindex + 1) {
-                prev_grade_str = to_string(nindex + 1);
-            } else {
-                prev_grade_str = to_string(nindex + 1) + "-" + to_string(endind);
-            }
-        }
-        cout << "<td>" << prev_grade_str << "</td>";
-        cout << "<td>" << u.name << "</td>";
-        if (!hide_group) {
-            cout << "<td>" << u.group << "</td>";
-        }
-
-        cout << "<td>" << u.total_score << "</td>";
-        if (show_percent) {
-            double pp = u.total_score * 100.0 / max_score;
-            char buf[64];
-            sprintf(buf, "%.2g%%", pp);
-            cout << "<td>" << buf << "</td>";
-        }
-        cout << "<td>" << u.total_prob << "</td>";
-
-        if (show_problems) {
-            for (const auto &pn : problem_order) {
-                if (auto mi = problems.find(pn); mi != problems.end()) {
-                    const ProblemInfo &prob_info = mi->second;
-                    const auto &cc = u.row[prob_info.get_column()];
-                    cout << "<td>";
-                    switch (cc.get_status()) {
-                    case CellStatus::EMPTY:
-                        cout << "&nbsp;";
-                        break;
-                    case CellStatus::PARTIAL:
-                        cout << cc.get_score();
-                        break;
-                    case CellStatus::FULL:
-                        cout << "<b>" << cc.get_score() << "</b>";
-                        break;
-                    }
-                    cout << "</td>";
-                }
+    out << "</tr>" << '\n';
+}
+
+void Course::render_row_cells(const RatingResult &r, int nindex, OutputWriter &out) const
+{
+    const int id = r.order[nindex];
+    const UserInfo &u = r.users[id];
+
+    out << "<td>" << u.name << "</td>";
+    if (!hide_group) {
+        out << "<td>" << u.group << "</td>";
+    }
+
+    out << "<td>" << u.total_score << "</td>";
+    if (show_percent) {
+        double pp = u.total_score * 100.0 / max_score;
+        out << "<td>";
+        out.general(pp, 2) << "%</td>";
+    }
+    out << "<td>" << u.total_prob << "</td>";
+
+    if (show_problems) {
+        for (const ProblemInfo *pp : order_probs) {
+            const ProblemInfo &prob_info = *pp;
+            const Cell empty;
+            const auto &cc = (prob_info.get_column() >= 0)?r.cells.at(id, prob_info.get_id()):empty;
+            out << "<td>";
+            switch (cc.get_status()) {
+            case CellStatus::EMPTY:
+                out << "&nbsp;";
+                break;
+            case CellStatus::PARTIAL:
+                out << cc.get_score();
+                break;
+            case CellStatus::FULL:
+                out << "<b>" << cc.get_score() << "</b>";
+                break;
             }
+            out << "</td>";
         }
+    }
 
-        if (!hide_summary) {
-            int grad_summ = 0;
-            for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
-                int perc1 = 0;
-                int perc2 = 0;
-                if (grades[i].max_score > 0) {
-                    perc1 = (u.score_by_grad[i] * 100LL + grades[i].max_score - 1) / grades[i].max_score;
-                }
-                if (grades[i].prob_count > 0) {
-                    perc2 = (u.prob_by_grad[i] * 100LL + grades[i].prob_count - 1) / grades[i].prob_count;
-                }
-                if (perc1 < 0) perc1 = 0;
-                if (perc1 > 100) perc1 = 100;
-                    int mark = grades[i].marks[perc1];
-                    if (mark < 0) mark = 0;
-                    u.mark_by_grad[i] = mark;
-                    (void) perc2;
-                    grad_summ += mark;
-            }
-
-            if (show_accumulated) {
-                // FIXME: use config!!!
-                const static int grad_summ_map[] =
-                {
-                    0, 2, 3, 5, 7, 8, 10
-                };
-                cout << "<td><b>" << grad_summ_map[grad_summ] << "</b></td>";
-            }
-
-            if (!hide_grades) {
-                for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
-                    cout << "<td><b>" << u.mark_by_grad[i] << "</b></td>";
-                }
-            }
+    if (!hide_summary) {
+        if (show_accumulated) {
+            // FIXME: use config!!!
+            const static int grad_summ_map[] =
+            {
+                0, 2, 3, 5, 7, 8, 10
+            };
+            out << "<td><b>" << grad_summ_map[u.grad_summ] << "</b></td>";
+        }
 
-            for (int i = 0; i < int(u.score_by_cat.size()); ++i) {
-                cout << "<td>" << u.score_by_cat[i] << "</td>";
-                cout << "<td>" << u.prob_by_cat[i] << "</td>";
+        if (!hide_grades) {
+            for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
+                out << "<td><b>" << u.mark_by_grad[i] << "</b></td>";
             }
-            if (!hide_marks) {
-                for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
-                    int perc1 = 0;
-                    int perc2 = 0;
-                    if (grades[i].max_score > 0) {
-                        perc1 = (u.score_by_grad[i] * 100LL + grades[i].max_score - 1) / grades[i].max_score;
-                    }
-                    if (grades[i].prob_count > 0) {
-                        perc2 = (u.prob_by_grad[i] * 100LL + grades[i].prob_count - 1) / grades[i].prob_count;
-                    }
-                    (void) perc2;
+        }
 
-                    //cout << "/" << perc1 << "/" << perc2;
-                    cout << "<td>" << u.score_by_grad[i] << " (" << perc1 << "%)" << "</td>";
-                    cout << "<td>" << u.prob_by_grad[i] << "</td>";
+        for (int i = 0; i < int(u.score_by_cat.size()); ++i) {
+            out << "<td>" << u.score_by_cat[i] << "</td>";
+            out << "<td>" << u.prob_by_cat[i] << "</td>";
+        }
+        if (!hide_marks) {
+            for (int i = 0; i < int(u.score_by_grad.size()); ++i) {
+                out << "<td>" << u.score_by_grad[i] << " (" << u.perc_by_grad[i] << "%)" << "</td>";
+                out << "<td>" << u.prob_by_grad[i] << "</td>";
 
-                    if (!hide_grades) {
-                        cout << "<td><b>" << u.mark_by_grad[i] << "</b></td>";
-                    }
+                if (!hide_grades) {
+                    out << "<td><b>" << u.mark_by_grad[i] << "</b></td>";
                 }
             }
         }
-        cout << "</tr>" << endl;
-        cout << endl;
     }
-    cout << "</tbody>" << endl;
-    cout << "</table>" << endl;
+}
 
+void Course::render_statistics(const RatingResult &r, OutputWriter &out) const
+{
     if (!hide_statistics) {
-        cout << "<h2>Statistics</h2>" << endl;
-
-        cout << "<table class=\"sortable\" border=\"1\">" << endl;
-        cout << "<thead>" << endl;
-        cout << "<tr><th>Group</th><th>Users</th><th>Rating average</th><th>R. mediana</th><th>R. sigma</th><th>Score average</th><th>S. mediana</th><th>S. sigma</th><th>Problem average</th><th>P. mediana</th><th>P. sigma</th></tr>" << endl;
-        cout << "</thead>" << endl;
-        cout << "<tbody>" << endl;
-        for (auto &g : groups) {
-            cout << "<tr>";
-            cout << "<td>" << g.get_name() << "</td>";
-            cout << "<td>" << g.get_user_count() << "</td>";
-            cout << "<td>" << g.get_place_avg_str() << "</td>";
-            cout << "<td>" << g.get_place_mediana_str() << "</td>";
-            cout << "<td>" << g.get_place_s_str() << "</td>";
-            cout << "<td>" << g.get_score_avg_str() << "</td>";
-            cout << "<td>" << g.get_score_mediana_str() << "</td>";
-            cout << "<td>" << g.get_score_s_str() << "</td>";
-            cout << "<td>" << g.get_problem_avg_str() << "</td>";
-            cout << "<td>" << g.get_problem_mediana_str() << "</td>";
-            cout << "<td>" << g.get_problem_s_str() << "</td>";
-            cout << "</tr>" << endl;
-        }
-        cout << "</tbody>" << endl;
-
-        cout << "<tfoot>" << endl;
-        cout << "<tr>";
-        cout << "<td>" << group_all.get_name() << "</td>";
-        cout << "<td>" << group_all.get_user_count() << "</td>";
-        cout << "<td>" << group_all.get_place_avg_str() << "</td>";
-        cout << "<td>" << group_all.get_place_mediana_str() << "</td>";
-        cout << "<td>" << group_all.get_place_s_str() << "</td>";
-        cout << "<td>" << group_all.get_score_avg_str() << "</td>";
-        cout << "<td>" << group_all.get_score_mediana_str() << "</td>";
-        cout << "<td>" << group_all.get_score_s_str() << "</td>";
-        cout << "<td>" << group_all.get_problem_avg_str() << "</td>";
-        cout << "<td>" << group_all.get_problem_mediana_str() << "</td>";
-        cout << "<td>" << group_all.get_problem_s_str() << "</td>";
-        cout << "</tr>" << endl;
-        cout << "</tfoot>" << endl;
-
-        cout << "</table>" << endl;
+        out << "<h2>Statistics</h2>" << '\n';
+
+        out << "<table class=\"sortable\" border=\"1\">" << '\n';
+        out << "<thead>" << '\n';
+        out << "<tr><th>Group</th><th>Users</th><th>Rating average</th><th>R. mediana</th><th>R. sigma</th><th>Score average</th><th>S. mediana</th><th>S. sigma</th><th>Problem average</th><th>P. mediana</th><th>P. sigma</th></tr>" << '\n';
+        out << "</thead>" << '\n';
+        out << "<tbody>" << '\n';
+        for (const auto &g : r.groups) {
+            out << "<tr>";
+            out << "<td>" << g.get_name() << "</td>";
+            out << "<td>" << g.get_user_count() << "</td>";
+            out << "<td>" << g.get_place_avg_str() << "</td>";
+            out << "<td>" << g.get_place_mediana_str() << "</td>";
+            out << "<td>" << g.get_place_s_str() << "</td>";
+            out << "<td>" << g.get_score_avg_str() << "</td>";
+            out << "<td>" << g.get_score_mediana_str() << "</td>";
+            out << "<td>" << g.get_score_s_str() << "</td>";
+            out << "<td>" << g.get_problem_avg_str() << "</td>";
+            out << "<td>" << g.get_problem_mediana_str() << "</td>";
+            out << "<td>" << g.get_problem_s_str() << "</td>";
+            out << "</tr>" << '\n';
+        }
+        out << "</tbody>" << '\n';
+
+        out << "<tfoot>" << '\n';
+        out << "<tr>";
+        out << "<td>" << r.group_all.get_name() << "</td>";
+        out << "<td>" << r.group_all.get_user_count() << "</td>";
+        out << "<td>" << r.group_all.get_place_avg_str() << "</td>";
+        out << "<td>" << r.group_all.get_place_mediana_str() << "</td>";
+        out << "<td>" << r.group_all.get_place_s_str() << "</td>";
+        out << "<td>" << r.group_all.get_score_avg_str() << "</td>";
+        out << "<td>" << r.group_all.get_score_mediana_str() << "</td>";
+        out << "<td>" << r.group_all.get_score_s_str() << "</td>";
+        out << "<td>" << r.group_all.get_problem_avg_str() << "</td>";
+        out << "<td>" << r.group_all.get_problem_mediana_str() << "</td>";
+        out << "<td>" << r.group_all.get_problem_s_str() << "</td>";
+        out << "</tr>" << '\n';
+        out << "</tfoot>" << '\n';
+
+        out << "</table>" << '\n';
+    }
+
+    if (show_problem_statistics) {
+        out << "<h2>Problem statistics</h2>" << '\n';
+
+        out << "<table class=\"sortable\" border=\"1\">" << '\n';
+        out << "<thead>" << '\n';
+        out << "<tr><th>Problem</th><th>Group</th><th>Attempted</th><th>Solved</th><th>Score average</th><th>S. mediana</th><th>Max score</th><th title=\"Scores by tenths of the full score\">Histogram</th></tr>" << '\n';
+        out << "</thead>" << '\n';
+        out << "<tbody>" << '\n';
+        for (const auto &ps : r.problems) {
+            for (int g = 0; g <= int(ps.groups.size()); ++g) {
+                const ProblemStats &st = g < int(ps.groups.size()) ? ps.groups[g] : ps.all;
+                out << "<tr>";
+                out << "<td>" << ps.name << "</td>";
+                out << "<td>" << (g < int(ps.groups.size()) ? r.groups[g].get_name() : r.group_all.get_name()) << "</td>";
+                out << "<td>" << st.attempted << "</td>";
+                out << "<td>" << st.solved << "</td>";
+                if (st.attempted > 0) {
+                    out << "<td>";
+                    out.fixed(st.scores.get_mean(), 2) << "</td>";
+                    out << "<td>";
+                    out.fixed(st.scores.get_median(), 2) << "</td>";
+                    out << "<td>" << st.max_score << "</td>";
+                } else {
+                    out << "<td>N/A</td><td>N/A</td><td>N/A</td>";
+                }
+                out << "<td>";
+                for (int i = 0; i < 10; ++i) {
+                    if (i > 0) out << ' ';
+                    out << st.tenths[i];
+                }
+                out << "</td>";
+                out << "</tr>" << '\n';
+            }
+        }
+        out << "</tbody>" << '\n';
+        out << "</table>" << '\n';
     }
+}
 
+bool Course::render_page_tail(OutputWriter &out) const
+{
     if (notes_name.size() > 0) {
-        cout << read_file(notes_name);
+        if (!copy_file(out, notes_name)) return false;
     }
 
-    cout << "<hr/>" << endl;
-    cout << "<p><i>Generated " << get_current_time_str() << "</i></p>" << endl;
+    out << "<hr/>" << '\n';
+    out << "<p><i>Generated " << get_current_time_str() << "</i></p>" << '\n';
 
     if (footer_name.size() > 0) {
-        cout << read_file(footer_name);
+        if (!copy_file(out, footer_name)) return false;
     } else {
-        cout << "</body>" << endl;
-        cout << "</html>" << endl;
+        out << "</body>" << '\n';
+        out << "</html>" << '\n';
+    }
+    return true;
+}
+
+bool Course::render(const RatingResult &r, OutputWriter &out,
+                    OutputWriter *json, OutputWriter *csv) const
+{
+    PhaseTimer timer(profile, "render");
+    if (json) render_json_head(*json);
+    if (csv) render_csv_head(*csv);
+    if (!render_page_head(out)) return false;
+    out << "<h1>Rating</h1>" << '\n';
+    render_table(r, nullptr, out, json, csv);
+    render_statistics(r, out);
+    return render_page_tail(out);
+}
+
+/*
+ * Splits the rating into the pages asked for by the config: one page per
+ * group with its members, and pages of page_rows consecutive positions.
+ * Takes the memberships from the course, so r has to be the result of
+ * the latest compute().
+ */
+vector<RatingPage> Course::get_pages(const RatingResult &r) const
+{
+    vector<RatingPage> pages;
+    const int nusers = r.order.size();
+    if (group_pages) {
+        size_t first = pages.size();
+        for (int g = 0; g < int(groups.size()); ++g) {
+            RatingPage page;
+            page.file = "group" + to_string(g + 1) + ".html";
+            page.title = groups[g].get_name();
+            pages.push_back(std::move(page));
+        }
+        for (int i = 0; i < nusers; ++i) {
+            int id = r.order[i];
+            if (id >= int(usergrsets.size())) continue;
+            for (int g : usergrsets[id]) {
+                pages[first + g].rows.push_back(i);
+            }
+        }
+    }
+    if (page_rows > 0) {
+        for (int i = 0, k = 1; i < nusers; i += page_rows, ++k) {
+            RatingPage page;
+            page.file = "page" + to_string(k) + ".html";
+            page.title = to_string(i + 1) + "-" + to_string(min(nusers, i + page_rows));
+            for (int j = i; j < nusers && j < i + page_rows; ++j) {
+                page.rows.push_back(j);
+            }
+            pages.push_back(std::move(page));
+        }
     }
+    return pages;
+}
+
+bool Course::render_page(const RatingResult &r, const RatingPage &page, OutputWriter &out) const
+{
+    if (!render_page_head(out)) return false;
+    out << "<h1>Rating: " << page.title << "</h1>" << '\n';
+    out << "<p><a href=\"index.html\">All pages</a></p>" << '\n';
+    render_table(r, &page.rows, out);
+    return render_page_tail(out);
 }
 
-int main(int argc, char *argv[])
+bool Course::render_index(const RatingResult &r, const vector<RatingPage> &pages, OutputWriter &out) const
 {
-    Course course;
+    if (!render_page_head(out)) return false;
+    out << "<h1>Rating</h1>" << '\n';
+    out << "<ul>" << '\n';
+    for (const auto &page : pages) {
+        out << "<li><a href=\"" << page.file << "\">" << page.title << "</a> (" << int(page.rows.size()) << ")</li>" << '\n';
+    }
+    out << "</ul>" << '\n';
+    render_statistics(r, out);
+    return render_page_tail(out);
+}
+
+void Profile::set_counter(const string &name, long long value)
+{
+    for (auto &c : counters) {
+        if (c.first == name) {
+            c.second = value;
+            return;
+        }
+    }
+    counters.emplace_back(name, value);
+}
 
-    for (int i = 1; i < argc; ++i) {
-        if (!course.parse_config(argv[i])) return 1;
+void Profile::write_text(FILE *f) const
+{
+    fprintf(f, "%-32s %10s %10s %10s %12s\n", "phase", "wall ms", "cpu ms", "allocs", "alloc KiB");
+    for (const auto &p : phases) {
+        fprintf(f, "%-32s %10.3f %10.3f %10llu %12llu\n", p.name.c_str(), p.wall_ms, p.cpu_ms,
+                (unsigned long long) p.allocs, (unsigned long long) (p.alloc_bytes / 1024));
+    }
+    if (!groups.empty()) {
+        fprintf(f, "\n%-16s %-6s %12s %8s %10s %10s %10s %10s\n", "group", "source", "bytes", "rows", "cells",
+                "parse ms", "cpu ms", "merge ms");
+        for (const auto &g : groups) {
+            fprintf(f, "%-16s %-6s %12llu %8d %10d %10.3f %10.3f %10.3f\n", g.name.c_str(), g.source,
+                    (unsigned long long) g.bytes, g.rows, g.cells, g.parse_ms, g.cpu_ms, g.merge_ms);
+        }
     }
-    if (!course.process_groups()) return 1;
-    course.assign_columns();
-    course.assign_users();
+    if (!counters.empty()) {
+        fprintf(f, "\n");
+        for (const auto &c : counters) {
+            fprintf(f, "%-32s %12lld\n", c.first.c_str(), c.second);
+        }
+    }
+}
 
-    return 0;
+void Profile::write_json(OutputWriter &out) const
+{
+    out << "{\n\"phases\": [";
+    for (int i = 0; i < int(phases.size()); ++i) {
+        const Phase &p = phases[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"name\": ";
+        write_json_string(out, p.name);
+        out << ", \"wall_ms\": ";
+        out.fixed(p.wall_ms, 3) << ", \"cpu_ms\": ";
+        out.fixed(p.cpu_ms, 3) << ", \"allocs\": " << (long long) p.allocs
+            << ", \"alloc_bytes\": " << (long long) p.alloc_bytes << '}';
+    }
+    out << "\n],\n\"groups\": [";
+    for (int i = 0; i < int(groups.size()); ++i) {
+        const Group &g = groups[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"name\": ";
+        write_json_string(out, g.name);
+        out << ", \"source\": \"" << g.source << "\", \"bytes\": " << (long long) g.bytes
+            << ", \"rows\": " << g.rows << ", \"cells\": " << g.cells << ", \"parse_ms\": ";
+        out.fixed(g.parse_ms, 3) << ", \"cpu_ms\": ";
+        out.fixed(g.cpu_ms, 3) << ", \"merge_ms\": ";
+        out.fixed(g.merge_ms, 3) << '}';
+    }
+    out << "\n],\n\"counters\": {";
+    for (int i = 0; i < int(counters.size()); ++i) {
+        out << (i > 0 ? ",\n" : "\n");
+        write_json_string(out, counters[i].first);
+        out << ": " << counters[i].second;
+    }
+    out << "\n}\n}\n";
 }
 
 /*
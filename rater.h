@@ -0,0 +1,1013 @@
+/*
+ * Rating library: loads the course config and the ejudge standings of
+ * the groups, computes the rating and renders it as an HTML page.
+ *
+ *     Course course;
+ *     course.parse_config("course.cfg");
+ *     course.process_groups();
+ *     course.assign_columns();
+ *     RatingResult r = course.compute();
+ *     course.render(r, out);
+ */
+#ifndef RATER_H
+#define RATER_H
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <charconv>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <cerrno>
+
+class MappedFile;
+class GroupCache;
+
+enum class CellStatus : unsigned char
+{
+    EMPTY, PARTIAL, FULL
+};
+
+class Cell
+{
+    CellStatus status = CellStatus::EMPTY;
+    int score = 0;
+
+public:
+    Cell() {}
+    Cell(CellStatus status_, int score_) : status(status_), score(score_) {}
+    CellStatus get_status() const { return status; }
+    int get_score() const { return score; }
+};
+
+/*
+ * Streaming statistics of a series of integers: count, mean and variance
+ * by Welford's method and, if enabled, exact percentiles. The values from
+ * 0 to the bound given by the caller (the largest possible score or
+ * problem count) are counted in a histogram, so its size does not depend
+ * on the number of values; the rare values outside it, e.g. a score above
+ * the configured full score, are counted one by one. The histogram is
+ * limited to HISTOGRAM_MAX_SIZE buckets whatever the bound, larger values
+ * are counted as outside. Partial results, e.g. of several threads, are
+ * combined with merge().
+ */
+class IntStats
+{
+    long long count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    bool with_histogram = false;
+    std::vector<long long> histogram;  // value -> number of occurrences
+    std::map<int, long long> outside;  // value -> occurrences, for the values out of the histogram
+
+    void count_value(int v, long long n)
+    {
+        if (v >= 0 && v < int(histogram.size())) histogram[v] += n;
+        else outside[v] += n;
+    }
+
+public:
+    static const int HISTOGRAM_MAX_SIZE = 1 << 20;
+
+    explicit IntStats(bool with_histogram_ = true, int max_value = -1) : with_histogram(with_histogram_)
+    {
+        if (with_histogram && max_value >= 0) histogram.resize(std::min(max_value, HISTOGRAM_MAX_SIZE - 1) + 1);
+    }
+
+    void add(int v)
+    {
+        ++count;
+        double delta = v - mean;
+        mean += delta / count;
+        m2 += delta * (v - mean);
+        if (with_histogram) count_value(v, 1);
+    }
+
+    void merge(const IntStats &o)
+    {
+        if (o.count == 0) return;
+        if (count == 0 && histogram.size() == o.histogram.size()) {
+            *this = o;
+            return;
+        }
+        long long n = count + o.count;
+        double delta = o.mean - mean;
+        mean += delta * o.count / n;
+        m2 += o.m2 + delta * delta * (double(count) * o.count / n);
+        count = n;
+        if (with_histogram) {
+            for (size_t v = 0; v < o.histogram.size(); ++v) {
+                if (o.histogram[v] > 0) count_value(v, o.histogram[v]);
+            }
+            for (const auto &p : o.outside) count_value(p.first, p.second);
+        }
+    }
+
+    long long get_count() const { return count; }
+    double get_mean() const { return count > 0 ? mean : 0.0; }
+    // sample standard deviation
+    double get_sigma() const { return count > 1 ? std::sqrt(m2 / (count - 1)) : 0.0; }
+
+    // the value of the given 0-based rank in the sorted series
+    int get_value_at(long long rank) const
+    {
+        auto above = outside.lower_bound(0);
+        for (auto it = outside.begin(); it != above; ++it) {
+            if (rank < it->second) return it->first;
+            rank -= it->second;
+        }
+        for (size_t v = 0; v < histogram.size(); ++v) {
+            if (rank < histogram[v]) return v;
+            rank -= histogram[v];
+        }
+        for (auto it = above; it != outside.end(); ++it) {
+            if (rank < it->second) return it->first;
+            rank -= it->second;
+        }
+        return 0;
+    }
+    // p in [0, 1], interpolated between the closest ranks
+    double get_percentile(double p) const
+    {
+        if (count <= 0 || !with_histogram) return 0.0;
+        double pos = p * (count - 1);
+        long long lo = (long long) pos;
+        double v = get_value_at(lo);
+        if (pos > lo) v += (get_value_at(lo + 1) - v) * (pos - lo);
+        return v;
+    }
+    double get_median() const
+    {
+        if (count <= 0 || !with_histogram) return 0.0;
+        if (count % 2) return get_value_at(count / 2);
+        return (get_value_at(count / 2 - 1) + get_value_at(count / 2) + 0.0) / 2;
+    }
+};
+
+/*
+ * Format of a group file: a rendered ejudge standings page or an XML run
+ * log exported from ejudge.
+ */
+enum class GroupFormat
+{
+    HTML,
+    RUNLOG
+};
+
+/*
+ * Statistics of the users of a group. The users are added in the rating
+ * order, so the places come in increasing order: their median is picked
+ * at the middle positions, which are known once expect() has been told
+ * the final number of users. Scores and problem counts keep histograms.
+ */
+class GroupInfo
+{
+    std::string name;
+    std::string file;
+    GroupFormat file_format = GroupFormat::HTML;
+
+    int user_count = 0;
+
+    IntStats places{false};
+    IntStats scores;
+    IntStats problems;
+
+    long long place_index = 0;
+    long long place_mid_index[2] = { -1, -1 };
+    int place_mid[2] = { 0, 0 };
+
+    static std::string format(double v)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.2f", v);
+        return buf;
+    }
+
+public:
+    GroupInfo(const std::string &name_, const std::string &file_, GroupFormat file_format_ = GroupFormat::HTML)
+        : name(name_), file(file_), file_format(file_format_) {}
+    const std::string &get_name() const { return name; }
+    const std::string &get_file() const { return file; }
+    GroupFormat get_format() const { return file_format; }
+
+    void clear_stats()
+    {
+        *this = GroupInfo(name, file, file_format);
+    }
+
+    // total: the number of users the group will have; first: the position
+    // of the first user added to this object among them (for the partial
+    // statistics of a part of the rating); max_score, max_problems: bounds
+    // of the histograms, larger values are still accepted
+    void expect(long long total, long long first, int max_score, int max_problems)
+    {
+        place_index = first;
+        place_mid_index[0] = total > 0 ? (total - 1) / 2 : -1;
+        place_mid_index[1] = total > 0 ? total / 2 : -1;
+        scores = IntStats(true, max_score);
+        problems = IntStats(true, max_problems);
+    }
+
+    void add_stat(int place, int score, int problem)
+    {
+        ++user_count;
+        places.add(place);
+        for (int i = 0; i < 2; ++i) {
+            if (place_index == place_mid_index[i]) place_mid[i] = place;
+        }
+        ++place_index;
+        scores.add(score);
+        problems.add(problem);
+    }
+
+    // adds the statistics of the next part of the rating
+    void merge(const GroupInfo &o)
+    {
+        user_count += o.user_count;
+        places.merge(o.places);
+        scores.merge(o.scores);
+        problems.merge(o.problems);
+        for (int i = 0; i < 2; ++i) {
+            if (place_mid_index[i] < 0) place_mid_index[i] = o.place_mid_index[i];
+            if (place_mid_index[i] >= o.place_index - o.user_count && place_mid_index[i] < o.place_index) {
+                place_mid[i] = o.place_mid[i];
+            }
+        }
+        place_index = o.place_index;
+    }
+
+    int get_user_count() const { return user_count; }
+
+    double get_place_avg() const { return places.get_mean(); }
+    std::string get_place_avg_str() const
+    {
+        if (user_count <= 0) return "N/A";
+        return format(get_place_avg());
+    }
+    double get_score_avg() const { return scores.get_mean(); }
+    std::string get_score_avg_str() const
+    {
+        if (user_count <= 0) return "N/A";
+        return format(get_score_avg());
+    }
+    double get_problem_avg() const { return problems.get_mean(); }
+    std::string get_problem_avg_str() const
+    {
+        if (user_count <= 0) return "N/A";
+        return format(get_problem_avg());
+    }
+
+    double get_place_s() const { return places.get_sigma(); }
+    std::string get_place_s_str() const
+    {
+        if (user_count <= 1) return "N/A";
+        return format(get_place_s());
+    }
+    double get_score_s() const { return scores.get_sigma(); }
+    std::string get_score_s_str() const
+    {
+        if (user_count <= 1) return "N/A";
+        return format(get_score_s());
+    }
+    double get_problem_s() const { return problems.get_sigma(); }
+    std::string get_problem_s_str() const
+    {
+        if (user_count <= 1) return "N/A";
+        return format(get_problem_s());
+    }
+
+    double get_place_mediana() const
+    {
+        if (user_count <= 0) return 0.0;
+        return (place_mid[0] + place_mid[1] + 0.0) / 2;
+    }
+    std::string get_place_mediana_str() const
+    {
+        return format(get_place_mediana());
+    }
+    double get_score_mediana() const { return scores.get_median(); }
+    std::string get_score_mediana_str() const
+    {
+        return format(get_score_mediana());
+    }
+    double get_problem_mediana() const { return problems.get_median(); }
+    std::string get_problem_mediana_str() const
+    {
+        return format(get_problem_mediana());
+    }
+    const IntStats &get_score_stats() const { return scores; }
+    const IntStats &get_problem_stats() const { return problems; }
+};
+
+class ProblemInfo
+{
+    std::string name;
+    int score = 0;
+    std::string category;
+    int column = -1;
+    int id = -1;
+
+public:
+    ProblemInfo(const std::string &name_, int score_, const std::string &category_) : name(name_), score(score_), category(category_) {}
+    const std::string &get_name() const { return name; }
+    int get_score() const { return score; }
+    const std::string &get_category() const { return category; }
+
+    void set_column(int column) { this->column = column; }
+    int get_column() const { return column; }
+    void set_id(int id) { this->id = id; }
+    int get_id() const { return id; }
+};
+
+struct CategorySpec
+{
+    std::string name;
+    bool crediting;
+    std::string grader;
+
+    CategorySpec(const std::string &name_, bool crediting_, const std::string &grader_) : name(name_), crediting(crediting_), grader(grader_) {}
+};
+
+struct CategoryInfo
+{
+    int index = 0;
+    bool crediting = false;
+    std::string grader;
+    int count = 0;
+    int current = 0;
+    int start_pos = 0;
+    int max_score = 0;
+
+    CategoryInfo(int index_, bool crediting_, const std::string &grader_) : index(index_), crediting(crediting_), grader(grader_) {}
+};
+
+struct UserInfo
+{
+    std::string name;
+    std::string group;
+    std::vector<int> score_by_cat;
+    std::vector<int> prob_by_cat;
+    std::vector<int> score_by_grad;
+    std::vector<int> prob_by_grad;
+    std::vector<int> perc_by_grad;
+    std::vector<int> mark_by_grad;
+
+    int total_score = 0;
+    int total_prob = 0;
+    int grad_summ = 0;
+
+public:
+    UserInfo(const std::string &name_, const std::string &group_, int cat_count, int grad_count)
+        : name(name_), group(group_),
+          score_by_cat(cat_count), prob_by_cat(cat_count),
+          score_by_grad(grad_count), prob_by_grad(grad_count), perc_by_grad(grad_count), mark_by_grad(grad_count, -1)
+    {
+    }
+};
+
+struct GradeInfo
+{
+    std::string name;
+    int mode = 0;
+    int marks[101];
+    int max_score = 0;
+    int prob_count = 0;
+
+public:
+    GradeInfo(const std::string &name_, int mode_) : name(name_), mode(mode_)
+    {
+        memset(marks, -1, sizeof(marks));
+    }
+};
+
+/*
+ * Receives a copy of every chunk an OutputWriter writes out, e.g. to
+ * compress the output on the way. A tap destroyed before commit() leaves
+ * no trace of its stream.
+ */
+class OutputTap
+{
+public:
+    virtual ~OutputTap() {}
+    virtual void consume(const char *s, size_t n) = 0;
+    // ends the stream, returns false if anything failed
+    virtual bool finish() = 0;
+    // puts the finished stream in place, once the output itself is
+    virtual bool commit() = 0;
+};
+
+/*
+ * Buffered writer for the generated pages. Output is collected in one
+ * reusable buffer and written to the file descriptor, or appended to the
+ * sink string, when the buffer is full or on flush(). Numbers are
+ * formatted with to_chars.
+ */
+class OutputWriter
+{
+    int fd = -1;
+    std::string *sink = nullptr;
+    std::vector<char> buf;
+    size_t used = 0;
+    uint64_t written = 0;
+    bool failed = false;
+    std::vector<std::unique_ptr<OutputTap>> taps;
+
+    void write_all(const char *s, size_t n)
+    {
+        for (auto &t : taps) t->consume(s, n);
+        if (sink) {
+            sink->append(s, n);
+            return;
+        }
+        while (n > 0 && !failed) {
+            ssize_t w = ::write(fd, s, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                failed = true;
+                break;
+            }
+            s += w;
+            n -= w;
+        }
+    }
+
+public:
+    explicit OutputWriter(size_t capacity = 1 << 20) : buf(capacity) {}
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter &operator = (const OutputWriter &) = delete;
+    ~OutputWriter() { flush(); }
+
+    // starts a new output, the buffer is kept; unfinished taps are dropped
+    void reset(int fd)
+    {
+        flush();
+        taps.clear();
+        this->fd = fd;
+        sink = nullptr;
+        used = 0;
+        written = 0;
+        failed = false;
+    }
+    // starts a new output collected in s
+    void reset(std::string &s)
+    {
+        reset(-1);
+        sink = &s;
+    }
+    void add_tap(std::unique_ptr<OutputTap> tap) { taps.push_back(std::move(tap)); }
+    // flushes the output and finishes the taps, which are moved to
+    // finished to be committed; if anything failed, they are dropped
+    bool finish_taps(std::vector<std::unique_ptr<OutputTap>> &finished)
+    {
+        bool ok = flush();
+        for (auto &t : taps) {
+            if (ok && !t->finish()) ok = false;
+        }
+        if (ok) finished = std::move(taps);
+        taps.clear();
+        return ok;
+    }
+
+    bool flush()
+    {
+        if (used > 0 && (fd >= 0 || sink)) write_all(buf.data(), used);
+        used = 0;
+        return !failed;
+    }
+    bool is_ok() const { return !failed; }
+    int get_fd() const { return fd; }
+    // bytes written since reset()
+    uint64_t get_written() const { return written; }
+
+    OutputWriter &write(const char *s, size_t n)
+    {
+        written += n;
+        if (n > buf.size() - used) {
+            flush();
+            if (n >= buf.size()) {
+                write_all(s, n);
+                return *this;
+            }
+        }
+        memcpy(buf.data() + used, s, n);
+        used += n;
+        return *this;
+    }
+
+    OutputWriter &operator << (std::string_view s) { return write(s.data(), s.size()); }
+    OutputWriter &operator << (const char *s) { return write(s, strlen(s)); }
+    OutputWriter &operator << (const std::string &s) { return write(s.data(), s.size()); }
+    OutputWriter &operator << (char c) { return write(&c, 1); }
+    OutputWriter &operator << (long long v)
+    {
+        char tmp[32];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        return write(tmp, r.ptr - tmp);
+    }
+    OutputWriter &operator << (int v) { return *this << (long long) v; }
+    OutputWriter &operator << (long v) { return *this << (long long) v; }
+    OutputWriter &operator << (unsigned long v) { return *this << (long long) v; }
+
+    // printf("%.*f")
+    OutputWriter &fixed(double v, int precision)
+    {
+        char tmp[64];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v, std::chars_format::fixed, precision);
+        return write(tmp, r.ptr - tmp);
+    }
+    // printf("%.*g")
+    OutputWriter &general(double v, int precision)
+    {
+        char tmp[64];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v, std::chars_format::general, precision);
+        return write(tmp, r.ptr - tmp);
+    }
+};
+
+/*
+ * Contents of one standings table, in document order. The texts point
+ * into the input file (or into 'owned' when the parser had to copy them).
+ */
+struct GroupData
+{
+    struct Entry
+    {
+        std::string_view user;
+        std::string_view problem;
+        Cell cell;
+    };
+
+    std::vector<std::string_view> users;
+    std::vector<Entry> cells;
+    std::deque<std::string> owned;
+    std::vector<std::shared_ptr<const GroupData> > parts;  // other owners of the texts
+    bool self_contained = false;
+
+    // copies all texts into 'owned', so that the input file can be released
+    void own()
+    {
+        if (self_contained) return;
+        self_contained = true;
+        std::unordered_map<const char *, std::string_view> copies;
+        auto keep = [&](std::string_view &text) {
+            auto it = copies.find(text.data());
+            if (it != copies.end() && it->second.size() == text.size()) {
+                text = it->second;
+            } else {
+                owned.emplace_back(text);
+                std::string_view stored = owned.back();
+                copies[text.data()] = stored;
+                text = stored;
+            }
+        };
+        for (auto &user : users) {
+            keep(user);
+        }
+        for (auto &e : cells) {
+            keep(e.user);
+            keep(e.problem);
+        }
+    }
+};
+
+/*
+ * Fingerprints and decoded contents of the data rows of a kept group,
+ * used to re-parse only the rows which changed.
+ */
+struct GroupRows
+{
+    bool valid = false;
+    uint64_t head_hash = 0;
+    std::vector<uint64_t> hashes;
+    std::vector<std::string> texts;
+    std::vector<std::shared_ptr<const GroupData> > rows;
+};
+
+// 64-bit hash of a byte string
+uint64_t hash_bytes(std::string_view s);
+// s as a quoted JSON string
+void write_json_string(OutputWriter &out, std::string_view s);
+
+/*
+ * Open-addressing hash table from names to integer ids, with linear
+ * probing in a power-of-two table kept at most half full. The names are
+ * not copied: their storage has to outlive the index.
+ */
+class FlatIndex
+{
+    struct Slot
+    {
+        uint32_t tag = 0;  // high bits of the hash
+        int id = -1;
+    };
+    std::vector<Slot> slots;
+    std::vector<std::string_view> keys;  // by id
+    int count = 0;
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.resize(old.empty() ? 16 : old.size() * 2);
+        for (const Slot &s : old) {
+            if (s.id < 0) continue;
+            size_t i = locate(keys[s.id], hash_bytes(keys[s.id]));
+            slots[i] = s;
+        }
+    }
+    // the slot of the name, or the empty slot where it belongs
+    size_t locate(std::string_view name, uint64_t h) const
+    {
+        size_t mask = slots.size() - 1;
+        uint32_t tag = uint32_t(h >> 32);
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            const Slot &s = slots[i];
+            if (s.id < 0 || (s.tag == tag && keys[s.id] == name)) return i;
+        }
+    }
+
+public:
+    void clear()
+    {
+        slots.clear();
+        keys.clear();
+        count = 0;
+    }
+    int size() const { return count; }
+    int find(std::string_view name) const
+    {
+        if (slots.empty()) return -1;
+        return slots[locate(name, hash_bytes(name))].id;
+    }
+    // returns the id of the name, adding it with the given id if it is new
+    int insert(std::string_view name, int id)
+    {
+        if ((count + 1) * 2 > int(slots.size())) grow();
+        uint64_t h = hash_bytes(name);
+        Slot &s = slots[locate(name, h)];
+        if (s.id >= 0) return s.id;
+        if (id >= int(keys.size())) keys.resize(id + 1);
+        keys[id] = name;
+        s.tag = uint32_t(h >> 32);
+        s.id = id;
+        ++count;
+        return id;
+    }
+};
+
+/*
+ * Maps names to dense integer ids in the order of first appearance.
+ */
+class StringInterner
+{
+    std::deque<std::string> names;
+    FlatIndex index;
+
+public:
+    StringInterner() = default;
+    StringInterner(const StringInterner &) = delete;
+    StringInterner &operator = (const StringInterner &) = delete;
+    StringInterner(StringInterner &&) = default;
+    StringInterner &operator = (StringInterner &&) = default;
+
+    int intern(std::string_view name)
+    {
+        int id = index.find(name);
+        if (id >= 0) return id;
+        names.emplace_back(name);
+        return index.insert(names.back(), int(names.size() - 1));
+    }
+    int find(std::string_view name) const { return index.find(name); }
+    const std::string &get_name(int id) const { return names[id]; }
+    int size() const { return int(names.size()); }
+};
+
+/*
+ * Standings cells, one row per user id and one column per problem id,
+ * stored contiguously. EMPTY cells mean that there is no result.
+ */
+class CellMatrix
+{
+    int rows = 0;
+    int cols = 0;
+    std::vector<Cell> data;
+
+public:
+    void resize(int new_rows, int new_cols)
+    {
+        new_rows = std::max(new_rows, rows);
+        new_cols = std::max(new_cols, cols);
+        if (new_cols != cols) {
+            std::vector<Cell> ndata(size_t(new_rows) * new_cols);
+            for (int r = 0; r < rows; ++r) {
+                std::copy(data.begin() + size_t(r) * cols, data.begin() + size_t(r + 1) * cols, ndata.begin() + size_t(r) * new_cols);
+            }
+            data.swap(ndata);
+            cols = new_cols;
+        } else if (new_rows != rows) {
+            data.resize(size_t(new_rows) * cols);
+        }
+        rows = new_rows;
+    }
+    int get_rows() const { return rows; }
+    int get_cols() const { return cols; }
+    Cell &at(int row, int col) { return data[size_t(row) * cols + col]; }
+    const Cell &at(int row, int col) const { return data[size_t(row) * cols + col]; }
+};
+
+/*
+ * Timings and counters of a run, collected while the profile is attached
+ * to a course with Course::set_profile(). CPU times of the phases are
+ * process times, so they include the worker threads; CPU times of the
+ * groups are those of the thread which parsed them, without the helper
+ * threads a large table is split among.
+ */
+struct Profile
+{
+    struct Phase
+    {
+        std::string name;
+        double wall_ms = 0;
+        double cpu_ms = 0;
+        uint64_t allocs = 0;
+        uint64_t alloc_bytes = 0;
+    };
+    struct Group
+    {
+        std::string name;
+        const char *source = "file";   // "file" or "cache"
+        uint64_t bytes = 0;
+        int rows = 0;
+        int cells = 0;
+        double parse_ms = 0;
+        double cpu_ms = 0;
+        double merge_ms = 0;
+    };
+
+    std::vector<Phase> phases;
+    std::vector<Group> groups;
+    std::vector<std::pair<std::string, long long> > counters;
+    // reads the totals of a counting allocator, if the program has one
+    void (*read_allocs)(uint64_t &count, uint64_t &bytes) = nullptr;
+
+    void set_counter(const std::string &name, long long value);
+    void write_text(FILE *f) const;
+    void write_json(OutputWriter &out) const;
+};
+
+/*
+ * Results of one problem among the users of a group or among all users.
+ */
+struct ProblemStats
+{
+    int attempted = 0;  // non-empty cells
+    int solved = 0;     // cells with the full score
+    int max_score = 0;
+    IntStats scores;
+    int tenths[10] = {};  // cells by tenths of the full score
+};
+
+struct ProblemSummary
+{
+    std::string name;
+    int score = 0;                     // the full score from the config
+    std::vector<ProblemStats> groups;  // by group index
+    ProblemStats all;
+};
+
+/*
+ * Everything needed to render a rating: computed once by Course::compute(),
+ * independent of later changes to the course data.
+ */
+struct RatingResult
+{
+    std::vector<UserInfo> users;    // by user id
+    std::vector<int> order;         // user ids in the rating order
+    std::vector<std::string> places;     // place range for each position in order
+    CellMatrix cells;          // user id x problem id
+    std::vector<GroupInfo> groups;  // group statistics
+    GroupInfo group_all{"All", ""};
+    std::vector<ProblemSummary> problems;  // in the config order, if show_problem_statistics
+    int best_score = 0;
+};
+
+/*
+ * One page of a split rating: the members of a group or a range of
+ * positions, with their places in the whole rating.
+ */
+struct RatingPage
+{
+    std::string file;       // file name in the pages directory
+    std::string title;
+    std::vector<int> rows;  // positions in RatingResult::order
+};
+
+class Course
+{
+    // the maps of the config are only looked up while it is read, the
+    // later lookups go through the flat tables of freeze()
+    std::vector<GroupInfo> groups;
+    std::map<std::string, int> groupidx;
+    std::vector<std::string> problem_order;
+    std::map<std::string, ProblemInfo> problems;
+    StringInterner user_ids;
+    StringInterner problem_ids;
+    std::vector<std::string> usergroups;
+    std::vector<std::vector<int> > usergrsets;  // user id -> indexes of its groups, ascending
+    std::vector<int> name_rank;  // user id -> position in the name order
+    CellMatrix cells;
+    std::vector<CategorySpec> categories;
+    std::vector<CategoryInfo> catinfos;  // category index -> counts, by assign_columns()
+    std::vector<int> prob_cat;   // problem id -> category index, negative if not counted
+    std::vector<int> cat_grade;  // category index -> grade index or -1
+    // flat tables of the config keys, rebuilt by freeze()
+    FlatIndex group_index;                        // group name -> group index
+    FlatIndex category_index;                     // category name -> index of its first spec
+    FlatIndex grade_index;                        // grade name -> grade index
+    std::vector<const ProblemInfo *> order_probs;  // problem_order entries found in problems
+    std::vector<const ProblemInfo *> id_probs;     // problem id -> entry in problems or null
+    int problem_count = 0;
+    std::vector<GradeInfo> grades;
+    std::map<std::string, int> grade_idx;
+    int sort_mode = 0;
+    bool hide_summary = false;
+    bool show_problems = false;
+    bool show_accumulated = false;
+    bool hide_marks = false;
+    bool hide_grades = false;
+    bool show_percent = false;
+    bool hide_group = false;
+    bool hide_statistics = false;
+    bool show_problem_statistics = false;
+    bool use_htmlcxx = false;
+    int thread_count = 1;
+    int shard_index = 0;
+    int shard_count = 1;
+    Profile *profile = nullptr;
+    int invalid_lines = 0;
+    bool keep_groups = false;
+    std::vector<GroupData> loaded;   // by group index, when keep_groups is set
+    std::vector<GroupRows> row_index;  // by group index, when keep_groups is set
+    std::string cache_dir;
+    std::unique_ptr<GroupCache> cache;
+    std::string footer_name;
+    std::string header_name;
+    std::string notes_name;
+    std::string json_name;
+    std::string csv_name;
+    std::string pages_dir;
+    bool group_pages = false;
+    int page_rows = 0;
+    int gzip_level = -1;
+    int brotli_level = -1;
+    std::string live_tag;
+    int max_score = 0;
+
+public:
+    Course();
+    ~Course();
+    Course(const Course &) = delete;
+    Course &operator = (const Course &) = delete;
+
+    void add_group(const std::string &name, const std::string &file, GroupFormat format = GroupFormat::HTML)
+    {
+        if (groupidx.find(name) != groupidx.end()) return;
+        groups.push_back(GroupInfo(name, file, format));
+        groupidx.insert(std::make_pair(name, int(groups.size() - 1)));
+    }
+    void add_problem(const std::string &name, int score, const std::string &category)
+    {
+        problem_order.push_back(name);
+        auto it = problems.insert(std::make_pair(name, ProblemInfo(name, score, category))).first;
+        it->second.set_id(problem_ids.intern(name));
+        max_score += score;
+    }
+
+    void set_thread_count(int count) { thread_count = count; }
+    void set_keep_groups(bool keep) { keep_groups = keep; }
+    // process_groups() takes only the index-th of count contiguous ranges
+    // of the groups, for write_partial()
+    void set_shard(int index, int count)
+    {
+        shard_index = index;
+        shard_count = count;
+    }
+    void set_profile(Profile *p) { profile = p; }
+    // when set, the rating table carries the tag and its rows the user
+    // names, for the updates of rater-live.js
+    void set_live_tag(const std::string &tag) { live_tag = tag; }
+    const std::vector<GroupInfo> &get_groups() const { return groups; }
+    const std::string &get_json_name() const { return json_name; }
+    const std::string &get_csv_name() const { return csv_name; }
+    const std::string &get_pages_dir() const { return pages_dir; }
+    // levels of the .gz/.br copies of the output files, -1 if not wanted
+    int get_gzip_level() const { return gzip_level; }
+    int get_brotli_level() const { return brotli_level; }
+    std::vector<std::string> get_page_files() const
+    {
+        std::vector<std::string> files;
+        for (const std::string *f : { &header_name, &footer_name, &notes_name }) {
+            if (!f->empty()) files.push_back(*f);
+        }
+        return files;
+    }
+    int get_worker_count() const
+    {
+        if (thread_count > 0) return thread_count;
+        return std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    // Reads a config file; groups are loaded by process_groups() or
+    // supplied from memory with ingest_group().
+    bool parse_config(const char *path);
+    bool process_groups();
+    bool update_groups(const std::vector<int> &changed, std::vector<int> *failed = nullptr);
+    bool ingest_group(const std::string &name, std::string_view html);
+    // Saves the groups of the shard, so that merge_partials() on all the
+    // partials loads the same data as process_groups() over all groups.
+    bool write_partial(OutputWriter &out) const;
+    bool merge_partials(const std::vector<std::string> &paths);
+    // Once all the groups are in: assign_columns(), then compute() the
+    // rating and render() it as many times as needed.
+    void assign_columns();
+    RatingResult compute();
+    // json and csv, when set, receive the same rating in machine-readable
+    // form; all the outputs are written in one pass over the users.
+    // Returns false if a header, notes or footer file cannot be read.
+    bool render(const RatingResult &r, OutputWriter &out,
+                OutputWriter *json = nullptr, OutputWriter *csv = nullptr) const;
+    bool assign_users(OutputWriter &out)
+    {
+        return render(compute(), out);
+    }
+    // The rating split into pages with an index page; the pages only read
+    // r and the course, so they can be rendered concurrently.
+    std::vector<RatingPage> get_pages(const RatingResult &r) const;
+    bool render_page(const RatingResult &r, const RatingPage &page, OutputWriter &out) const;
+    bool render_index(const RatingResult &r, const std::vector<RatingPage> &pages, OutputWriter &out) const;
+    // Parts of the rating table, for diffs between two renderings: the
+    // header row and the cells of the row at position nindex which follow
+    // its place.
+    void render_table_head(OutputWriter &out) const;
+    void render_row_cells(const RatingResult &r, int nindex, OutputWriter &out) const;
+
+private:
+    struct GroupUpdate
+    {
+        int index = -1;
+        bool partial = false;
+        // the rows which changed, if partial
+        std::vector<std::shared_ptr<const GroupData> > added;
+        std::vector<std::shared_ptr<const GroupData> > removed;
+        // the replaced contents of the group, if not partial
+        std::shared_ptr<const GroupData> previous;
+    };
+
+    void invalid_line(const char *line);
+    void get_shard_range(int &first, int &last) const;
+    void freeze();
+    int add_user_group(std::string_view user, int group);
+    void add_cell(int user_id, std::string_view problem, const Cell &cell);
+    void load_group(std::string_view html, GroupData &data) const;
+    void decode_group(int index, std::string_view text, GroupData &data) const;
+    void merge_group(int index, const GroupData &data);
+    bool fetch_group(int index, std::unique_ptr<MappedFile> &file, GroupData &data, bool &ready) const;
+    void parse_group(int index, const MappedFile &file, GroupData &data) const;
+    bool process_group(int index);
+    bool reparse_rows(int index, std::string_view html, GroupData &data, bool &partial,
+                      std::vector<std::shared_ptr<const GroupData> > &added, std::vector<std::shared_ptr<const GroupData> > &removed);
+    bool remerge_users(const std::vector<GroupUpdate> &updates);
+    void decode_update(GroupUpdate &update, std::string_view html, GroupData &data);
+    void commit_updates(const std::vector<GroupUpdate> &updates);
+    void aggregate(std::vector<UserInfo> &users) const;
+    void compute_group_stats(RatingResult &r) const;
+    void compute_problem_stats(RatingResult &r) const;
+    bool render_page_head(OutputWriter &out) const;
+    void render_table(const RatingResult &r, const std::vector<int> *rows, OutputWriter &out,
+                      OutputWriter *json = nullptr, OutputWriter *csv = nullptr) const;
+    void render_statistics(const RatingResult &r, OutputWriter &out) const;
+    bool render_page_tail(OutputWriter &out) const;
+    void render_json_head(OutputWriter &out) const;
+    void render_json_user(const RatingResult &r, int nindex, OutputWriter &out) const;
+    void render_csv_head(OutputWriter &out) const;
+    void render_csv_user(const RatingResult &r, int nindex, OutputWriter &out) const;
+};
+
+#endif // RATER_H
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,86 @@
+/*
+ * rater-merge: renders the rating from the partials that
+ * "ejudge-rater --shard K/N --partial FILE" wrote for all the shards of
+ * the same config. The output is the same as that of a single
+ * ejudge-rater run over all the groups.
+ *
+ *     rater-merge [-o FILE] [--json FILE] [--csv FILE] [--pages DIR]
+ *                 [--gzip LEVEL] [--brotli LEVEL] [-j N] -c CONFIG... PARTIAL...
+ */
+#include "rater.h"
+#include "outputs.h"
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    vector<const char *> configs;
+    vector<string> partials;
+    int thread_count = -1;
+    Outputs outs;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "-o") || !strcmp(argv[i], "--json")
+            || !strcmp(argv[i], "--csv") || !strcmp(argv[i], "--pages") || !strcmp(argv[i], "--gzip")
+            || !strcmp(argv[i], "--brotli")) {
+            const char *opt = argv[i];
+            if (++i >= argc) {
+                fprintf(stderr, "option '%s' requires an argument\n", opt);
+                return 1;
+            }
+            if (!strcmp(opt, "-c")) configs.push_back(argv[i]);
+            else if (!strcmp(opt, "-o")) outs.html_path = argv[i];
+            else if (!strcmp(opt, "--json")) outs.json_path = argv[i];
+            else if (!strcmp(opt, "--pages")) outs.pages_dir = argv[i];
+            else if (!strcmp(opt, "--gzip") || !strcmp(opt, "--brotli")) {
+                if (!parse_compression_level(opt, argv[i], outs.compression)) return 1;
+            }
+            else outs.csv_path = argv[i];
+            continue;
+        }
+        if (!strncmp(argv[i], "-j", 2)) {
+            const char *val = argv[i] + 2;
+            if (!*val) {
+                if (++i >= argc) {
+                    fprintf(stderr, "option '-j' requires an argument\n");
+                    return 1;
+                }
+                val = argv[i];
+            }
+            char *eptr = NULL;
+            long v = strtol(val, &eptr, 10);
+            if (*eptr || v < 0 || v > 1024) {
+                fprintf(stderr, "invalid thread count '%s'\n", val);
+                return 1;
+            }
+            thread_count = v;
+            continue;
+        }
+        partials.push_back(argv[i]);
+    }
+    if (configs.empty()) {
+        fprintf(stderr, "usage: %s [-o FILE] [--json FILE] [--csv FILE] [--pages DIR] [--gzip LEVEL] [--brotli LEVEL] [-j N] -c CONFIG... PARTIAL...\n", argv[0]);
+        return 1;
+    }
+
+    Course course;
+    for (const char *path : configs) {
+        if (!course.parse_config(path)) return 1;
+    }
+    if (thread_count >= 0) course.set_thread_count(thread_count);
+    if (!course.merge_partials(partials)) return 1;
+    course.assign_columns();
+    return write_output(course, outs) ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,719 @@
+#include "serve.h"
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <map>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+
+// requests with a longer head are refused
+const size_t MAX_REQUEST_HEAD = 16384;
+// largest file served from the static directory
+const off_t MAX_STATIC_FILE = 16 << 20;
+// patches kept for the subscribers which reconnect
+const size_t LIVE_HISTORY = 32;
+// a subscriber with more unsent events is dropped
+const size_t MAX_QUEUED_EVENTS = 64;
+// idle event streams get a comment this often
+const int LIVE_PING_MS = 25000;
+
+static string make_etag(string_view body)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "\"%016llx-%llx\"", (unsigned long long) hash_bytes(body),
+             (unsigned long long) body.size());
+    return buf;
+}
+
+static bool equal_nocase(string_view a, string_view b)
+{
+    return a.size() == b.size() && !strncasecmp(a.data(), b.data(), a.size());
+}
+
+static string_view trim(string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// If-None-Match uses the weak comparison: W/ prefixes are ignored
+static bool etag_listed(string_view list, string_view etag)
+{
+    while (!list.empty()) {
+        size_t p = list.find(',');
+        string_view tag = trim(list.substr(0, p));
+        if (tag == "*") return true;
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+        if (tag == etag) return true;
+        if (p == string_view::npos) break;
+        list.remove_prefix(p + 1);
+    }
+    return false;
+}
+
+static const char *guess_content_type(const string &name)
+{
+    static const pair<const char *, const char *> types[] = {
+        { ".html", "text/html; charset=UTF-8" },
+        { ".js", "text/javascript; charset=UTF-8" },
+        { ".css", "text/css; charset=UTF-8" },
+        { ".json", "application/json" },
+        { ".csv", "text/csv; charset=UTF-8" },
+        { ".txt", "text/plain; charset=UTF-8" },
+        { ".png", "image/png" },
+        { ".svg", "image/svg+xml" },
+        { ".ico", "image/x-icon" },
+    };
+    for (const auto &t : types) {
+        size_t n = strlen(t.first);
+        if (name.size() > n && !name.compare(name.size() - n, n, t.first)) return t.second;
+    }
+    return "application/octet-stream";
+}
+
+static string base_name(const string &path)
+{
+    size_t p = path.rfind('/');
+    return p == string::npos ? path : path.substr(p + 1);
+}
+
+/*
+ * One client connection. Requests are taken one at a time: the response
+ * to a request is sent out completely before the next request, if the
+ * client has pipelined it, is looked at. A request for the event stream
+ * turns the connection into a subscriber, which only receives events
+ * from then on.
+ */
+class HttpConnection
+{
+    // a piece of the output, kept alive by its owner until it is sent
+    struct Chunk
+    {
+        shared_ptr<const void> owner;
+        string_view data;
+    };
+
+    RatingServer &server;
+    string in;
+    deque<Chunk> out;
+    size_t out_off = 0;
+    bool close_after = false;
+    bool streaming = false;
+    long stream_version = 0;
+
+    void push(shared_ptr<const string> s)
+    {
+        string_view data = *s;
+        out.push_back(Chunk{ std::move(s), data });
+    }
+
+    void respond(int code, const char *reason, const string &extra, shared_ptr<const ServedFile> file = nullptr)
+    {
+        char date[64];
+        time_t now = time(nullptr);
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        string head = "HTTP/1.1 " + to_string(code) + " " + reason + "\r\nDate: " + date + "\r\n" + extra;
+        if (close_after) head += "Connection: close\r\n";
+        head += "\r\n";
+        push(make_shared<const string>(std::move(head)));
+        if (file && !file->body.empty()) {
+            string_view data = file->body;
+            out.push_back(Chunk{ std::move(file), data });
+        }
+    }
+
+    void respond_error(int code, const char *reason)
+    {
+        auto f = make_shared<ServedFile>();
+        f->body = to_string(code) + " " + reason + "\n";
+        respond(code, reason, "Content-Type: text/plain; charset=UTF-8\r\nContent-Length: "
+                + to_string(f->body.size()) + "\r\n", f);
+    }
+
+    // starts the event stream of a client which has the rendering since
+    void subscribe(long since)
+    {
+        close_after = true;
+        streaming = true;
+        stream_version = since;
+        respond(200, "OK", "Content-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                "X-Accel-Buffering: no\r\n");
+        pull_events();
+    }
+
+    // answers the request in in[0, len), returns false if it is malformed
+    bool answer(size_t len)
+    {
+        string_view req(in.data(), len);
+        size_t eol = req.find("\r\n");
+        string_view line = req.substr(0, eol);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp2 == string_view::npos) return false;
+        string_view method = line.substr(0, sp1);
+        string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        string_view version = line.substr(sp2 + 1);
+        if (version.substr(0, 5) != "HTTP/") return false;
+
+        close_after = version == "HTTP/1.0";
+        string_view if_none_match;
+        string_view last_event_id;
+        bool has_inm = false;
+        bool has_body = false;
+        for (size_t p = eol + 2; p < len; ) {
+            size_t e = req.find("\r\n", p);
+            if (e == string_view::npos) e = len;
+            string_view h = req.substr(p, e - p);
+            p = e + 2;
+            size_t colon = h.find(':');
+            if (colon == string_view::npos) continue;
+            string_view name = h.substr(0, colon);
+            string_view value = trim(h.substr(colon + 1));
+            if (equal_nocase(name, "If-None-Match")) {
+                if_none_match = value;
+                has_inm = true;
+            } else if (equal_nocase(name, "Last-Event-ID")) {
+                last_event_id = value;
+            } else if (equal_nocase(name, "Connection")) {
+                if (equal_nocase(value, "close")) close_after = true;
+                else if (equal_nocase(value, "keep-alive")) close_after = false;
+            } else if (equal_nocase(name, "Content-Length")) {
+                if (value != "0") has_body = true;
+            } else if (equal_nocase(name, "Transfer-Encoding")) {
+                has_body = true;
+            }
+        }
+        // request bodies are not read, so the connection ends after them
+        if (has_body) close_after = true;
+
+        bool is_head = method == "HEAD";
+        if (!is_head && method != "GET") {
+            respond_error(405, "Method Not Allowed");
+            return true;
+        }
+        size_t qpos = target.find('?');
+        string path(target.substr(0, min(qpos, target.find('#'))));
+        if (path == "/events" && server.live && !is_head) {
+            // EventSource sends the id of the last event it got when it
+            // reconnects, the page asks with the version it was rendered as
+            string_view since = last_event_id;
+            if (since.empty() && qpos != string_view::npos) {
+                string_view query = target.substr(qpos + 1);
+                if (query.substr(0, 6) == "since=") since = query.substr(6, query.find('&') - 6);
+            }
+            long v = -1;
+            from_chars(since.data(), since.data() + since.size(), v);
+            subscribe(v);
+            return true;
+        }
+
+        shared_ptr<const ServedFile> f;
+        shared_ptr<const ServedSite> site = server.get_site();
+        auto it = site ? site->find(path) : ServedSite::const_iterator();
+        if (site && it != site->end()) {
+            f = it->second;
+        } else if (path.size() > 1 && path[0] == '/' && path.find('/', 1) == string::npos && path[1] != '.') {
+            f = server.read_static(path.substr(1));
+        }
+        if (!f) {
+            respond_error(site ? 404 : 503, site ? "Not Found" : "Service Unavailable");
+            return true;
+        }
+
+        string extra = "ETag: " + f->etag + "\r\nCache-Control: no-cache\r\n";
+        if (has_inm && etag_listed(if_none_match, f->etag)) {
+            respond(304, "Not Modified", extra);
+            return true;
+        }
+        extra += "Content-Type: " + f->content_type + "\r\nContent-Length: " + to_string(f->body.size()) + "\r\n";
+        respond(200, "OK", extra, is_head ? nullptr : f);
+        return true;
+    }
+
+public:
+    const int fd;
+
+    HttpConnection(RatingServer &server, int fd) : server(server), fd(fd) {}
+    ~HttpConnection() { close(fd); }
+
+    bool is_sending() const { return !out.empty(); }
+    bool is_streaming() const { return streaming; }
+
+    // queues the events published since the last call, returns false if
+    // the client does not keep up with them
+    bool pull_events()
+    {
+        vector<shared_ptr<const string>> events;
+        server.get_events(stream_version, events);
+        for (auto &e : events) push(std::move(e));
+        return out.size() <= MAX_QUEUED_EVENTS;
+    }
+
+    // keeps an idle event stream from being closed by proxies
+    void ping()
+    {
+        static const auto comment = make_shared<const string>(":\n\n");
+        if (streaming && out.empty()) push(comment);
+    }
+
+    /*
+     * Reads what the client has sent and answers the complete requests
+     * until the socket cannot take more. Returns false once the
+     * connection is to be closed.
+     */
+    bool on_readable()
+    {
+        char buf[4096];
+        while (true) {
+            ssize_t r = read(fd, buf, sizeof(buf));
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (r <= 0) return false;
+            // a subscriber has nothing more to ask
+            if (streaming) continue;
+            in.append(buf, r);
+            if (in.size() > MAX_REQUEST_HEAD) break;
+        }
+        return process();
+    }
+
+    bool process()
+    {
+        while (true) {
+            if (is_sending()) {
+                if (!send_pending()) return false;
+                if (is_sending()) return true;
+                if (streaming) return true;
+                if (close_after) return false;
+            }
+            if (streaming) return true;
+            size_t end = in.find("\r\n\r\n");
+            if (end == string::npos) {
+                if (in.size() <= MAX_REQUEST_HEAD) return true;
+                close_after = true;
+                respond_error(431, "Request Header Fields Too Large");
+                in.clear();
+                continue;
+            }
+            if (!answer(end + 2)) {
+                close_after = true;
+                respond_error(400, "Bad Request");
+            }
+            in.erase(0, end + 4);
+        }
+    }
+
+    // returns false on a write error
+    bool send_pending()
+    {
+        while (!out.empty()) {
+            struct iovec iov[8];
+            int cnt = 0;
+            for (size_t i = 0; i < out.size() && cnt < 8; ++i, ++cnt) {
+                size_t off = i ? 0 : out_off;
+                iov[cnt].iov_base = (void *) (out[i].data.data() + off);
+                iov[cnt].iov_len = out[i].data.size() - off;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = cnt;
+            ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            if (w <= 0) return false;
+            size_t n = w;
+            while (n > 0) {
+                size_t left = out.front().data.size() - out_off;
+                if (n < left) {
+                    out_off += n;
+                    break;
+                }
+                n -= left;
+                out.pop_front();
+                out_off = 0;
+            }
+        }
+        return true;
+    }
+};
+
+RatingServer::RatingServer(const string &static_dir) : static_dir(static_dir)
+{
+}
+
+RatingServer::~RatingServer()
+{
+    if (loop_thread.joinable()) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) {
+            fprintf(stderr, "cannot stop the server: %s\n", strerror(errno));
+        }
+        loop_thread.join();
+    }
+    for (int fd : { listen_fd, epoll_fd, stop_fd, wake_fd }) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool RatingServer::listen(const string &addr)
+{
+    size_t colon = addr.rfind(':');
+    string host = colon == string::npos ? string() : addr.substr(0, colon);
+    string port = colon == string::npos ? addr : addr.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *res = nullptr;
+    int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (err) {
+        fprintf(stderr, "invalid address '%s': %s\n", addr.c_str(), gai_strerror(err));
+        return false;
+    }
+    for (struct addrinfo *ai = res; ai && listen_fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+            err = errno;
+            close(fd);
+            continue;
+        }
+        listen_fd = fd;
+    }
+    freeaddrinfo(res);
+    if (listen_fd < 0) {
+        fprintf(stderr, "cannot listen on '%s': %s\n", addr.c_str(), strerror(err));
+        return false;
+    }
+    return true;
+}
+
+bool RatingServer::start()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd < 0 || stop_fd < 0 || wake_fd < 0) {
+        fprintf(stderr, "cannot start the server: %s\n", strerror(errno));
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = stop_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    loop_thread = thread([this] { run(); });
+    return true;
+}
+
+shared_ptr<const ServedSite> RatingServer::get_site()
+{
+    lock_guard<mutex> lock(site_mtx);
+    return site;
+}
+
+void RatingServer::get_events(long &since, vector<shared_ptr<const string>> &out)
+{
+    static const auto reload = make_shared<const string>("event: reload\ndata: reload\n\n");
+    lock_guard<mutex> lock(site_mtx);
+    if (since == version) return;
+    if (since < version - long(events.size()) || since > version) {
+        out.push_back(reload);
+    } else {
+        out.insert(out.end(), events.end() - (version - since), events.end());
+    }
+    since = version;
+}
+
+/*
+ * Reads a file of the static directory, such as sorttable.js. The files
+ * are small and rarely asked for once the browsers have them cached, so
+ * they are read again on every request.
+ */
+shared_ptr<const ServedFile> RatingServer::read_static(const string &name)
+{
+    if (static_dir.empty()) return nullptr;
+    string path = static_dir + "/" + name;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    shared_ptr<ServedFile> f;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size <= MAX_STATIC_FILE) {
+        f = make_shared<ServedFile>();
+        f->body.resize(st.st_size);
+        size_t got = 0;
+        while (got < f->body.size()) {
+            ssize_t r = read(fd, &f->body[got], f->body.size() - got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            got += r;
+        }
+        f->body.resize(got);
+        f->content_type = guess_content_type(name);
+        f->etag = make_etag(f->body);
+    }
+    close(fd);
+    return f;
+}
+
+void RatingServer::run()
+{
+    map<int, unique_ptr<HttpConnection>> conns;
+    auto watch = [&](HttpConnection &c, int op) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = c.is_sending() ? EPOLLOUT : EPOLLIN;
+        ev.data.fd = c.fd;
+        epoll_ctl(epoll_fd, op, c.fd, &ev);
+    };
+
+    // sends the output newly queued on an idle connection
+    auto send_queued = [&](map<int, unique_ptr<HttpConnection>>::iterator it) {
+        HttpConnection &c = *it->second;
+        if (!c.process()) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+            conns.erase(it);
+        } else if (c.is_sending()) {
+            watch(c, EPOLL_CTL_MOD);
+        }
+    };
+
+    struct epoll_event events[64];
+    auto last_ping = chrono::steady_clock::now();
+    while (true) {
+        int n = epoll_wait(epoll_fd, events, 64, live ? LIVE_PING_MS : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+            return;
+        }
+        if (live && chrono::steady_clock::now() - last_ping >= chrono::milliseconds(LIVE_PING_MS)) {
+            last_ping = chrono::steady_clock::now();
+            for (auto it = conns.begin(); it != conns.end(); ) {
+                auto cur = it++;
+                if (!cur->second->is_streaming() || cur->second->is_sending()) continue;
+                cur->second->ping();
+                send_queued(cur);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == stop_fd) return;
+            if (fd == wake_fd) {
+                uint64_t count;
+                if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    fprintf(stderr, "read from eventfd failed: %s\n", strerror(errno));
+                }
+                for (auto it = conns.begin(); it != conns.end(); ) {
+                    auto cur = it++;
+                    if (!cur->second->is_streaming()) continue;
+                    bool was_sending = cur->second->is_sending();
+                    if (!cur->second->pull_events()) {
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cur->first, nullptr);
+                        conns.erase(cur);
+                        continue;
+                    }
+                    // a stream already waiting for the socket sends on EPOLLOUT
+                    if (!was_sending) send_queued(cur);
+                }
+                continue;
+            }
+            if (fd == listen_fd) {
+                while (true) {
+                    int cfd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (cfd < 0) break;
+                    int one = 1;
+                    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    auto c = make_unique<HttpConnection>(*this, cfd);
+                    watch(*c, EPOLL_CTL_ADD);
+                    conns[cfd] = std::move(c);
+                }
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            HttpConnection &c = *it->second;
+            bool was_sending = c.is_sending();
+            bool keep;
+            if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) keep = false;
+            else if (was_sending) keep = c.process();
+            else keep = c.on_readable();
+            if (!keep) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                conns.erase(it);
+            } else if (c.is_sending() != was_sending) {
+                watch(c, EPOLL_CTL_MOD);
+            }
+        }
+    }
+}
+
+/*
+ * The event which brings the pages from the previous table to next: the
+ * rows whose position, place or cells changed, with only the parts which
+ * changed, and the users who left. A changed table head needs a reload.
+ */
+shared_ptr<const string> RatingServer::make_patch(const LiveTable &next, long to) const
+{
+    auto event = make_shared<string>();
+    OutputWriter w(1 << 16);
+    w.reset(*event);
+    w << "id: " << to << '\n';
+    if (table.head != next.head) {
+        w << "event: reload\ndata: reload\n\n";
+        w.flush();
+        return event;
+    }
+    w << "event: patch\ndata: {\"from\":" << to - 1 << ",\"to\":" << to << ",\"rows\":[";
+    unordered_map<string_view, int> prev;
+    prev.reserve(table.users.size());
+    for (int i = 0; i < int(table.users.size()); ++i) {
+        prev.emplace(table.users[i], i);
+    }
+    vector<char> kept(table.users.size());
+    bool first = true;
+    for (int i = 0; i < int(next.users.size()); ++i) {
+        auto it = prev.find(next.users[i]);
+        int old = it == prev.end() ? -1 : it->second;
+        if (old >= 0) kept[old] = 1;
+        bool new_place = old < 0 || table.places[old] != next.places[i];
+        bool new_cells = old < 0 || table.get_cells(old) != next.get_cells(i);
+        if (old == i && !new_place && !new_cells) continue;
+        w << (first ? "{\"u\":" : ",{\"u\":");
+        first = false;
+        write_json_string(w, next.users[i]);
+        w << ",\"n\":" << i;
+        if (new_place) {
+            w << ",\"place\":";
+            write_json_string(w, next.places[i]);
+        }
+        if (new_cells) {
+            w << ",\"html\":";
+            write_json_string(w, next.get_cells(i));
+        }
+        w << '}';
+    }
+    w << "],\"remove\":[";
+    first = true;
+    for (int i = 0; i < int(table.users.size()); ++i) {
+        if (kept[i]) continue;
+        if (!first) w << ',';
+        first = false;
+        write_json_string(w, table.users[i]);
+    }
+    w << "]}\n\n";
+    w.flush();
+    return event;
+}
+
+bool RatingServer::publish(Course &course, const RatingResult &r, Outputs &outs)
+{
+    auto next = make_shared<ServedSite>();
+    auto html = make_shared<ServedFile>();
+    html->content_type = "text/html; charset=UTF-8";
+    html->body.reserve(html_reserve);
+    const string &json_path = outs.json_path.empty() ? course.get_json_name() : outs.json_path;
+    shared_ptr<ServedFile> json;
+    if (!json_path.empty()) {
+        json = make_shared<ServedFile>();
+        json->content_type = "application/json";
+        json->body.reserve(json_reserve);
+    }
+
+    if (live) course.set_live_tag(to_string(version + 1));
+    outs.html.reset(html->body);
+    if (json) outs.json.reset(json->body);
+    bool ok = course.render(r, outs.html, json ? &outs.json : nullptr, nullptr);
+    outs.html.flush();
+    outs.json.flush();
+    outs.html.reset(-1);
+    outs.json.reset(-1);
+    course.set_live_tag(string());
+    if (!ok) return false;
+
+    shared_ptr<const string> event;
+    if (live) {
+        LiveTable next_table;
+        OutputWriter w(1 << 16);
+        w.reset(next_table.head);
+        course.render_table_head(w);
+        w.reset(next_table.cells);
+        for (int i = 0; i < int(r.order.size()); ++i) {
+            next_table.users.push_back(r.users[r.order[i]].name);
+            next_table.places.push_back(r.places[i]);
+            course.render_row_cells(r, i, w);
+            w.flush();
+            next_table.ends.push_back(next_table.cells.size());
+        }
+        w.reset(-1);
+        event = make_patch(next_table, version + 1);
+        table = std::move(next_table);
+    }
+
+    html->etag = make_etag(html->body);
+    html_reserve = html->body.size();
+    outs.html_bytes = html->body.size();
+    (*next)["/"] = html;
+    if (!outs.html_path.empty()) (*next)["/" + base_name(outs.html_path)] = html;
+    outs.json_bytes = 0;
+    if (json) {
+        json->etag = make_etag(json->body);
+        json_reserve = json->body.size();
+        outs.json_bytes = json->body.size();
+        (*next)["/" + base_name(json_path)] = json;
+    }
+
+    {
+        lock_guard<mutex> lock(site_mtx);
+        site = std::move(next);
+        ++version;
+        if (event) events.push_back(event);
+        if (events.size() > LIVE_HISTORY) events.pop_front();
+    }
+    uint64_t one = 1;
+    if (event && wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "cannot wake the server: %s\n", strerror(errno));
+    }
+    return true;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */
@@ -0,0 +1,116 @@
+/*
+ * HTTP server of the --serve mode: the rating is rendered into memory
+ * and served from there, so that the readers never touch the disk.
+ */
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "rater.h"
+#include "outputs.h"
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// one served document with its strong entity tag
+struct ServedFile
+{
+    std::string content_type;
+    std::string body;
+    std::string etag;
+};
+
+// the documents of one rendering by request path
+typedef std::map<std::string, std::shared_ptr<const ServedFile>> ServedSite;
+
+// the rating table of one rendering, to diff the next one against
+struct LiveTable
+{
+    std::string head;
+    std::vector<std::string> users;   // in the rating order
+    std::vector<std::string> places;
+    std::string cells;                // cells of all the rows but the places
+    std::vector<size_t> ends;         // end of the cells of each row
+
+    std::string_view get_cells(int i) const
+    {
+        size_t begin = i ? ends[i - 1] : 0;
+        return std::string_view(cells).substr(begin, ends[i] - begin);
+    }
+};
+
+/*
+ * Answers GET and HEAD requests from an epoll loop in a thread of its
+ * own. Every response carries the ETag of its document, and a request
+ * whose If-None-Match lists it gets "304 Not Modified". publish() swaps
+ * in a new rendering at once; the responses already being sent keep the
+ * rendering they started with.
+ *
+ * In the live mode every rendering is numbered, and the changes of the
+ * rating table against the previous rendering are pushed to the pages
+ * listening at /events as Server-Sent Events, which rater-live.js
+ * applies: the rows which changed or moved, the places which changed,
+ * the users who left. A client too far behind is told to reload.
+ */
+class RatingServer
+{
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int stop_fd = -1;
+    int wake_fd = -1;
+    std::string static_dir;
+    bool live = false;
+    std::mutex site_mtx;
+    // guarded by site_mtx
+    std::shared_ptr<const ServedSite> site;
+    long version = 0;
+    std::deque<std::shared_ptr<const std::string>> events;  // of the latest versions
+    // used by publish() only
+    LiveTable table;
+    std::thread loop_thread;
+    size_t html_reserve = 0;
+    size_t json_reserve = 0;
+
+    std::shared_ptr<const ServedSite> get_site();
+    std::shared_ptr<const ServedFile> read_static(const std::string &name);
+    // the events after the version since, or a reload if there are too many
+    void get_events(long &since, std::vector<std::shared_ptr<const std::string>> &out);
+    std::shared_ptr<const std::string> make_patch(const LiveTable &next, long to) const;
+    void run();
+
+    friend class HttpConnection;
+
+public:
+    // other paths of one component are files of static_dir, if it is set
+    explicit RatingServer(const std::string &static_dir = std::string());
+    ~RatingServer();
+    RatingServer(const RatingServer &) = delete;
+    RatingServer &operator = (const RatingServer &) = delete;
+
+    void set_live(bool enable) { live = enable; }
+    // binds to [HOST:]PORT, the host defaults to all the interfaces
+    bool listen(const std::string &addr);
+    // starts answering the requests
+    bool start();
+    /*
+     * Renders the rating r, computed by the latest course.compute(), into
+     * memory and serves it from now on: the page at "/" and at the name
+     * of the -o file, the JSON export, if any, at the name of its file.
+     * In the live mode, the changes of the table go to the subscribers.
+     * If the rendering fails, the previous one stays.
+     */
+    bool publish(Course &course, const RatingResult &r, Outputs &outs);
+};
+
+#endif // SERVE_H
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * end:
+ */